@@ -4,7 +4,7 @@
 // see http://create.stephan-brumme.com/disclaimer.html
 // Slice-by-16 code added by Bulat Ziganshin
 
-// g++ -o Crc32 Crc32.cpp -O3 -march=native -mtune=native
+// g++ -o Crc32 Crc32.cpp -O3 -march=native -mtune=native -pthread
 
 #include <stdlib.h>
 
@@ -16,6 +16,8 @@
 
 /// zlib's CRC32 polynomial
 const uint32_t Polynomial = 0xEDB88320;
+/// CRC32C (Castagnoli) polynomial, used by crc32cSlicingByXX
+const uint32_t PolynomialCastagnoli = 0x82F63B78;
 
 /// swap endianess
 static inline uint32_t swap(uint32_t x)
@@ -26,13 +28,219 @@ static inline uint32_t swap(uint32_t x)
          (x << 24);
 }
 
+/// common signature of all crc32_xx functions
+typedef uint32_t (*Crc32Function)(const void* data, size_t length, uint32_t previousCrc32);
+
+/// alignment of the lookup tables in bytes (64 = one table row never straddles two cache lines)
+#ifndef CRC32_TABLE_ALIGNMENT
+#define CRC32_TABLE_ALIGNMENT 64
+#endif
+
 /// forward declaration, table is at the end of this file
-uint32_t Crc32Lookup[16][256]; // extern is needed to keep compiler happey
+alignas(CRC32_TABLE_ALIGNMENT) uint32_t Crc32Lookup[16][256]; // extern is needed to keep compiler happey
+
+/// table layout used by crc32_fast: 0 = Crc32Lookup[16][256], 1 = interleaved [256][16], 2 = copy on a huge page
+/// (any layout except 0 implies CRC32_TABLE_LAYOUTS, which compiles the alternative layouts and their kernels)
+#ifndef CRC32_TABLE_LAYOUT
+#define CRC32_TABLE_LAYOUT 0
+#endif
+#if (CRC32_TABLE_LAYOUT != 0 || !defined(CRC32_NO_BENCHMARK)) && !defined(CRC32_TABLE_LAYOUTS)
+#define CRC32_TABLE_LAYOUTS
+#endif
+
+
+// //////////////////////////////////////////////////////////
+// optional instrumentation: compile with -DCRC32_STATS to count calls, bytes,
+// log2 size histogram and misaligned starts per kernel; crc32_stats_dump() prints the totals.
+// Counters are thread-local (no shared cache lines, no locked instructions) and merged on demand.
+// Without CRC32_STATS the CRC32_STATS_RECORD macro expands to nothing.
+
+#ifdef CRC32_STATS
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+
+/// instrumented entry points
+enum Crc32StatsKernel
+{
+  STATS_crc32_bitwise, STATS_crc32_halfbyte, STATS_crc32_1byte,
+  STATS_crc32_4bytes, STATS_crc32_2x4bytes, STATS_crc32_4x4bytes,
+  STATS_crc32_88bytes, STATS_crc32_8bytes, STATS_crc32_16bytes, STATS_crc32_2x16bytes,
+  STATS_crc32_2x8bytes, STATS_crc32_4x8bytes,
+  STATS_crc32cSlicingBy4, STATS_crc32cSlicingBy2x4, STATS_crc32cSlicingBy4x4,
+  STATS_crc32cSlicingBy8, STATS_crc32cSlicingBy16, STATS_crc32cSlicingBy32,
+  STATS_crc32c_sse42, STATS_crc32c_blocks, STATS_crc32c_halfbyte, STATS_crc32_halfbyte_simd,
+  STATS_crc32_16bytes_interleaved, STATS_crc32_2x16bytes_interleaved, STATS_crc32_16bytes_huge,
+  STATS_crc32_2x16bytes_huge, STATS_crc32_2bytes_16bit, STATS_crc32_8bytes_16bit,
+  STATS_crc32_16bytes_prefetch, STATS_crc32_16bytes_prefetch_nta,
+  STATS_crc32c_sse42_prefetch, STATS_crc32c_sse42_prefetch_nta,
+  STATS_crc32c_hash_u32, STATS_crc32c_hash_u64, STATS_crc32c_hash_u128, STATS_crc32_chorba,
+  STATS_crc32_messages, STATS_crc32_clmul, STATS_crc32c_clmul,
+  STATS_NumKernels
+};
+
+static const char* const Crc32StatsNames[STATS_NumKernels] =
+{
+  "crc32_bitwise", "crc32_halfbyte", "crc32_1byte",
+  "crc32_4bytes", "crc32_2x4bytes", "crc32_4x4bytes",
+  "crc32_88bytes", "crc32_8bytes", "crc32_16bytes", "crc32_2x16bytes",
+  "crc32_2x8bytes", "crc32_4x8bytes",
+  "crc32cSlicingBy4", "crc32cSlicingBy2x4", "crc32cSlicingBy4x4",
+  "crc32cSlicingBy8", "crc32cSlicingBy16", "crc32cSlicingBy32",
+  "crc32c_sse42", "crc32c_blocks", "crc32c_halfbyte", "crc32_halfbyte_simd",
+  "crc32_16bytes_interleaved", "crc32_2x16bytes_interleaved", "crc32_16bytes_huge",
+  "crc32_2x16bytes_huge", "crc32_2bytes_16bit", "crc32_8bytes_16bit",
+  "crc32_16bytes_prefetch", "crc32_16bytes_prefetch_nta",
+  "crc32c_sse42_prefetch", "crc32c_sse42_prefetch_nta",
+  "crc32c_hash_u32", "crc32c_hash_u64", "crc32c_hash_u128", "crc32_chorba",
+  "crc32_messages", "crc32_clmul", "crc32c_clmul"
+};
+
+/// histogram bucket b counts lengths in [2^(b-1), 2^b), bucket 0 counts empty calls
+const int Crc32StatsBuckets = 65;
+
+/// totals of one kernel
+struct Crc32KernelStats
+{
+  uint64_t calls, bytes, misaligned;
+  uint64_t sizes[Crc32StatsBuckets];
+};
+
+/// counters of one thread: only the owner writes them, relaxed atomics make concurrent reads well-defined
+/// (on x86 a relaxed load + store is a plain add to memory, no lock prefix)
+struct Crc32ThreadStats
+{
+  struct Kernel
+  {
+    std::atomic<uint64_t> calls, bytes, misaligned;
+    std::atomic<uint64_t> sizes[Crc32StatsBuckets];
+  } kernels[STATS_NumKernels];
+  Crc32ThreadStats *prev, *next;
+};
+
+/// live threads, plus totals of threads that already exited
+static std::mutex        Crc32StatsLock;
+static Crc32ThreadStats* Crc32StatsThreads = NULL;
+static Crc32KernelStats  Crc32StatsRetired[STATS_NumKernels];
+
+static thread_local Crc32ThreadStats* Crc32StatsMine = NULL;
+
+static inline void crc32_stats_add(std::atomic<uint64_t>& counter, uint64_t value)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/// add all counters of a thread to totals
+static void crc32_stats_merge(const Crc32ThreadStats* thread, Crc32KernelStats* totals)
+{
+  for (int k = 0; k < STATS_NumKernels; k++)
+  {
+    const Crc32ThreadStats::Kernel& kernel = thread->kernels[k];
+    totals[k].calls      += kernel.calls     .load(std::memory_order_relaxed);
+    totals[k].bytes      += kernel.bytes     .load(std::memory_order_relaxed);
+    totals[k].misaligned += kernel.misaligned.load(std::memory_order_relaxed);
+    for (int b = 0; b < Crc32StatsBuckets; b++)
+      totals[k].sizes[b] += kernel.sizes[b].load(std::memory_order_relaxed);
+  }
+}
+
+/// unregisters the counters when their thread exits
+struct Crc32StatsOwner
+{
+  Crc32ThreadStats* stats;
+  ~Crc32StatsOwner()
+  {
+    std::lock_guard<std::mutex> guard(Crc32StatsLock);
+    crc32_stats_merge(stats, Crc32StatsRetired);
+    if (stats->prev) stats->prev->next = stats->next; else Crc32StatsThreads = stats->next;
+    if (stats->next) stats->next->prev = stats->prev;
+    Crc32StatsMine = NULL;
+    delete stats;
+  }
+};
+
+/// slow path: first instrumented call of this thread
+static Crc32ThreadStats* crc32_stats_register()
+{
+  static thread_local Crc32StatsOwner owner;
+  Crc32ThreadStats* stats = new Crc32ThreadStats();  // value-initialized: all counters 0
+  std::lock_guard<std::mutex> guard(Crc32StatsLock);
+  stats->prev = NULL;
+  stats->next = Crc32StatsThreads;
+  if (Crc32StatsThreads)
+    Crc32StatsThreads->prev = stats;
+  Crc32StatsThreads = stats;
+  owner.stats    = stats;
+  Crc32StatsMine = stats;
+  return stats;
+}
+
+/// log2 size class
+static inline int crc32_stats_bucket(uint64_t length)
+{
+#ifdef __GNUC__
+  return length ? 64 - __builtin_clzll(length) : 0;
+#else
+  int bucket = 0;
+  while (length)
+    bucket++, length >>= 1;
+  return bucket;
+#endif
+}
+
+static inline void crc32_stats_record(int kernel, const void* data, uint64_t length)
+{
+  Crc32ThreadStats* stats = Crc32StatsMine;
+  if (!stats)
+    stats = crc32_stats_register();
+  Crc32ThreadStats::Kernel& counters = stats->kernels[kernel];
+  crc32_stats_add(counters.calls, 1);
+  crc32_stats_add(counters.bytes, length);
+  crc32_stats_add(counters.sizes[crc32_stats_bucket(length)], 1);
+  if ((uintptr_t) data & (sizeof(uint32_t) - 1))
+    crc32_stats_add(counters.misaligned, 1);
+}
+
+#define CRC32_STATS_RECORD(kernel, data, length) crc32_stats_record(STATS_##kernel, data, length)
+
+/// current totals of all threads, past and present
+void crc32_stats_snapshot(Crc32KernelStats totals[STATS_NumKernels])
+{
+  std::lock_guard<std::mutex> guard(Crc32StatsLock);
+  for (int k = 0; k < STATS_NumKernels; k++)
+    totals[k] = Crc32StatsRetired[k];
+  for (const Crc32ThreadStats* thread = Crc32StatsThreads; thread; thread = thread->next)
+    crc32_stats_merge(thread, totals);
+}
+
+/// print a table of all kernels that were called
+void crc32_stats_dump(FILE* out = stderr)
+{
+  Crc32KernelStats totals[STATS_NumKernels];
+  crc32_stats_snapshot(totals);
+
+  fprintf(out, "%-20s %12s %16s %12s  %s\n", "kernel", "calls", "bytes", "misaligned", "sizes (log2 buckets: count)");
+  for (int k = 0; k < STATS_NumKernels; k++)
+  {
+    if (totals[k].calls == 0)
+      continue;
+    fprintf(out, "%-20s %12llu %16llu %12llu ", Crc32StatsNames[k], (unsigned long long) totals[k].calls,
+            (unsigned long long) totals[k].bytes, (unsigned long long) totals[k].misaligned);
+    for (int b = 0; b < Crc32StatsBuckets; b++)
+      if (totals[k].sizes[b])
+        fprintf(out, " <2^%d:%llu", b, (unsigned long long) totals[k].sizes[b]);
+    fprintf(out, "\n");
+  }
+}
+#else
+#define CRC32_STATS_RECORD(kernel, data, length)
+#endif
 
 
 /// compute CRC32 (bitwise algorithm)
 uint32_t crc32_bitwise(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_bitwise, data, length);
   uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint8_t* current = (const uint8_t*) data;
 
@@ -59,19 +267,20 @@ uint32_t crc32_bitwise(const void* data, size_t length, uint32_t previousCrc32 =
 }
 
 
+/// look-up table for half-byte, same as crc32Lookup[0][16*i]
+static const uint32_t Crc32Lookup16[16] =
+{
+  0x00000000,0x1DB71064,0x3B6E20C8,0x26D930AC,0x76DC4190,0x6B6B51F4,0x4DB26158,0x5005713C,
+  0xEDB88320,0xF00F9344,0xD6D6A3E8,0xCB61B38C,0x9B64C2B0,0x86D3D2D4,0xA00AE278,0xBDBDF21C
+};
+
 /// compute CRC32 (half-byte algoritm)
 uint32_t crc32_halfbyte(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_halfbyte, data, length);
   uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint8_t* current = (const uint8_t*) data;
 
-  /// look-up table for half-byte, same as crc32Lookup[0][16*i]
-  static const uint32_t Crc32Lookup16[16] =
-  {
-    0x00000000,0x1DB71064,0x3B6E20C8,0x26D930AC,0x76DC4190,0x6B6B51F4,0x4DB26158,0x5005713C,
-    0xEDB88320,0xF00F9344,0xD6D6A3E8,0xCB61B38C,0x9B64C2B0,0x86D3D2D4,0xA00AE278,0xBDBDF21C
-  };
-
   while (length-- > 0)
   {
     crc = Crc32Lookup16[(crc ^  *current      ) & 0x0F] ^ (crc >> 4);
@@ -86,6 +295,7 @@ uint32_t crc32_halfbyte(const void* data, size_t length, uint32_t previousCrc32
 /// compute CRC32 (standard algorithm)
 uint32_t crc32_1byte(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_1byte, data, length);
   uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint8_t* current = (const uint8_t*) data;
 
@@ -99,6 +309,7 @@ uint32_t crc32_1byte(const void* data, size_t length, uint32_t previousCrc32 = 0
 /// compute CRC32 (Slicing-by-4 algorithm)
 uint32_t crc32_4bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_4bytes, data, length);
   uint32_t  crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint32_t* current = (const uint32_t*) data;
 
@@ -136,6 +347,7 @@ uint32_t crc32_4bytes(const void* data, size_t length, uint32_t previousCrc32 =
 /// compute CRC32 (Slicing-by-4 algorithm)
 uint32_t crc32_2x4bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_2x4bytes, data, length);
   uint32_t  crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint32_t* current = (const uint32_t*) data;
 
@@ -189,6 +401,7 @@ uint32_t crc32_2x4bytes(const void* data, size_t length, uint32_t previousCrc32
 /// compute CRC32 (Slicing-by-4 algorithm)
 uint32_t crc32_4x4bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_4x4bytes, data, length);
   uint32_t  crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint32_t* current = (const uint32_t*) data;
 
@@ -274,6 +487,7 @@ uint32_t crc32_4x4bytes(const void* data, size_t length, uint32_t previousCrc32
 /// compute CRC32 (Slicing-by-8 algorithm) ///////////////////////////////////////////////////////////////////////////////////////////
 uint32_t crc32_88bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_88bytes, data, length);
   uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint32_t* current = (const uint32_t*) data;
 
@@ -325,6 +539,7 @@ uint32_t crc32_88bytes(const void* data, size_t length, uint32_t previousCrc32 =
 /// compute CRC32 (Slicing-by-8 algorithm)
 uint32_t crc32_8bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_8bytes, data, length);
   uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint32_t* current = (const uint32_t*) data;
 
@@ -370,6 +585,7 @@ uint32_t crc32_8bytes(const void* data, size_t length, uint32_t previousCrc32 =
 /// compute CRC32 (Slicing-by-8 algorithm) //////////////////////////////////////////////////////////////////////////////////////////
 uint32_t crc32_16bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_16bytes, data, length);
   uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint32_t* current = (const uint32_t*) data;
 
@@ -412,6 +628,7 @@ uint32_t crc32_16bytes(const void* data, size_t length, uint32_t previousCrc32 =
 /// compute CRC32 (Slicing-by-8 algorithm) //////////////////////////////////////////////////////////////////////////////////////////
 uint32_t crc32_2x16bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_2x16bytes, data, length);
   uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint32_t* current = (const uint32_t*) data;
 
@@ -474,9 +691,120 @@ uint32_t crc32_2x16bytes(const void* data, size_t length, uint32_t previousCrc32
 }
 
 
+/// compute CRC32 (Chorba algorithm, Sam Russell 2024: no lookup tables in the main loop)
+/// x^(64*300) + x^(64*155) + x^(64*117) + x^(64*89) + 1 is a multiple of the polynomial,
+/// hence each 64-bit word can be replaced by XORing it into the words 145, 183, 211 and 300 words later;
+/// that leaves only the last 300 words (plus 0 to 7 bytes), which are processed by the standard algorithm.
+/// State: 4 KB ring of pending words + 2.4 KB window on the stack, 1 KB table for the window.
+uint32_t crc32_chorba(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  // the final window alone is 2400 bytes, shorter messages don't benefit
+  if (length < 8192)
+    return crc32_1byte(data, length, previousCrc32);
+  CRC32_STATS_RECORD(crc32_chorba, data, length);
+
+  const size_t WindowWords = 300;
+  const size_t RingSize    = 512; // power of two, more than 300 words
+  const uint64_t* current  = (const uint64_t*) data;
+  const size_t numWords    = length / 8;
+  // eliminate words four at a time: four independent XOR chains per iteration
+  const size_t eliminate   = (numWords - WindowWords) & ~size_t(3);
+
+  // ring[w % RingSize] = word w after all earlier words were XORed into it,
+  // ring[RingSize..RingSize+3] mirrors ring[0..3] so that four consecutive words never wrap around;
+  // words "before" the buffer are zero
+  uint64_t ring[RingSize + 4] = { 0 };
+
+  // start value is XORed into the first four bytes, afterwards the CRC runs without pre-inversion
+#if __BYTE_ORDER == __BIG_ENDIAN
+  const uint64_t start = uint64_t(swap(~previousCrc32)) << 32;
+#else
+  const uint64_t start = ~previousCrc32;
+#endif
+
+  for (size_t w = 0; w < eliminate; w += 4)
+  {
+    const uint64_t* a = ring + ((w - 145) % RingSize);
+    const uint64_t* b = ring + ((w - 183) % RingSize);
+    const uint64_t* c = ring + ((w - 211) % RingSize);
+    const uint64_t* d = ring + ((w - 300) % RingSize);
+    uint64_t m0 = current[w    ] ^ a[0] ^ b[0] ^ c[0] ^ d[0];
+    uint64_t m1 = current[w + 1] ^ a[1] ^ b[1] ^ c[1] ^ d[1];
+    uint64_t m2 = current[w + 2] ^ a[2] ^ b[2] ^ c[2] ^ d[2];
+    uint64_t m3 = current[w + 3] ^ a[3] ^ b[3] ^ c[3] ^ d[3];
+    if (w == 0)
+      m0 ^= start;
+
+    uint64_t* m = ring + (w % RingSize);
+    m[0] = m0; m[1] = m1; m[2] = m2; m[3] = m3;
+    if (m == ring)
+    {
+      ring[RingSize    ] = m0; ring[RingSize + 1] = m1;
+      ring[RingSize + 2] = m2; ring[RingSize + 3] = m3;
+    }
+  }
+
+  // last 300 to 303 words: only eliminated words contribute (unsigned w - offset wraps around if negative)
+  uint64_t window[WindowWords + 3 + 1];
+  const size_t windowWords = numWords - eliminate;
+  for (size_t w = eliminate; w < numWords; w++)
+  {
+    uint64_t m = current[w];
+    if (w - 145 < eliminate) m ^= ring[(w - 145) % RingSize];
+    if (w - 183 < eliminate) m ^= ring[(w - 183) % RingSize];
+    if (w - 211 < eliminate) m ^= ring[(w - 211) % RingSize];
+    if (w - 300 < eliminate) m ^= ring[(w - 300) % RingSize];
+    window[w - eliminate] = m;
+  }
+
+  // remaining 0 to 7 bytes are appended unchanged
+  const size_t   rest = length % 8;
+  const uint8_t* currentChar = (const uint8_t*) (current + numWords);
+  uint8_t*       windowChar  = (uint8_t*) (window + windowWords);
+  for (size_t i = 0; i < rest; i++)
+    windowChar[i] = currentChar[i];
+
+  // start value is already part of the window: CRC without pre-inversion
+  // (standard algorithm inline, so that the stats don't count the window as a crc32_1byte call)
+  uint32_t crc = 0;
+  const uint8_t* windowByte = (const uint8_t*) window;
+  for (size_t i = 0; i < windowWords * 8 + rest; i++)
+    crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ windowByte[i]];
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+
+/// one slicing-by-16 step with any [16][256] table
+static inline uint32_t crc32_slice16(const uint32_t (*table)[256], const uint32_t* current, uint32_t crc)
+{
+  uint32_t one = current[0] ^ crc;
+  uint32_t two = current[1];
+  uint32_t a3  = current[2];
+  uint32_t a4  = current[3];
+  return table[ 0][( a4>>24) & 0xFF] ^
+         table[ 1][( a4>>16) & 0xFF] ^
+         table[ 2][( a4>> 8) & 0xFF] ^
+         table[ 3][  a4      & 0xFF] ^
+         table[ 4][( a3>>24) & 0xFF] ^
+         table[ 5][( a3>>16) & 0xFF] ^
+         table[ 6][( a3>> 8) & 0xFF] ^
+         table[ 7][  a3      & 0xFF] ^
+         table[ 8][(two>>24) & 0xFF] ^
+         table[ 9][(two>>16) & 0xFF] ^
+         table[10][(two>> 8) & 0xFF] ^
+         table[11][ two      & 0xFF] ^
+         table[12][(one>>24) & 0xFF] ^
+         table[13][(one>>16) & 0xFF] ^
+         table[14][(one>> 8) & 0xFF] ^
+         table[15][ one      & 0xFF];
+}
+
+
 /// compute CRC32 (Slicing-by-8 algorithm)
 uint32_t crc32_2x8bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_2x8bytes, data, length);
   uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint32_t* current = (const uint32_t*) data;
 
@@ -548,6 +876,7 @@ uint32_t crc32_2x8bytes(const void* data, size_t length, uint32_t previousCrc32
 /// compute CRC32 (Slicing-by-8 algorithm)
 uint32_t crc32_4x8bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
+  CRC32_STATS_RECORD(crc32_4x8bytes, data, length);
   uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
   const uint32_t* current = (const uint32_t*) data;
 
@@ -668,6 +997,7 @@ uint32_t crc32_4x8bytes(const void* data, size_t length, uint32_t previousCrc32
 #include "crc32ctables.cc"
 
 uint32_t crc32cSlicingBy4(const void* data, size_t length, uint32_t crc) {
+    CRC32_STATS_RECORD(crc32cSlicingBy4, data, length);
     const char* p_buf = (const char*) data;
 
     // Handle leading misaligned bytes
@@ -703,6 +1033,7 @@ uint32_t crc32cSlicingBy4(const void* data, size_t length, uint32_t crc) {
 
 
 uint32_t crc32cSlicingBy2x4(const void* data, size_t length, uint32_t crc) {
+    CRC32_STATS_RECORD(crc32cSlicingBy2x4, data, length);
     const char* p_buf = (const char*) data;
 
     // Handle leading misaligned bytes
@@ -713,7 +1044,7 @@ uint32_t crc32cSlicingBy2x4(const void* data, size_t length, uint32_t crc) {
     }
 
     length -= initial_bytes;
-    size_t running_length = length & ~(sizeof(int32_t) - 1);
+    size_t running_length = length & ~(size_t(8) - 1);
     size_t end_bytes = length - running_length;
 
     for (size_t li = 0; li < running_length/8; li++) {
@@ -748,6 +1079,7 @@ uint32_t crc32cSlicingBy2x4(const void* data, size_t length, uint32_t crc) {
 
 
 uint32_t crc32cSlicingBy4x4(const void* data, size_t length, uint32_t crc) {
+    CRC32_STATS_RECORD(crc32cSlicingBy4x4, data, length);
     const char* p_buf = (const char*) data;
 
     // Handle leading misaligned bytes
@@ -758,7 +1090,7 @@ uint32_t crc32cSlicingBy4x4(const void* data, size_t length, uint32_t crc) {
     }
 
     length -= initial_bytes;
-    size_t running_length = length & ~(sizeof(int32_t) - 1);
+    size_t running_length = length & ~(size_t(16) - 1);
     size_t end_bytes = length - running_length;
 
     for (size_t li = 0; li < running_length/16; li++) {
@@ -813,6 +1145,7 @@ uint32_t crc32cSlicingBy4x4(const void* data, size_t length, uint32_t crc) {
 
 
 uint32_t crc32cSlicingBy8(const void* data, size_t length, uint32_t crc) {
+    CRC32_STATS_RECORD(crc32cSlicingBy8, data, length);
     const char* p_buf = (const char*) data;
 
     // Handle leading misaligned bytes
@@ -855,6 +1188,7 @@ uint32_t crc32cSlicingBy8(const void* data, size_t length, uint32_t crc) {
 }
 
 uint32_t crc32cSlicingBy16(const void* data, size_t length, uint32_t crc) {
+    CRC32_STATS_RECORD(crc32cSlicingBy16, data, length);
     const char* p_buf = (const char*) data;
 
     // Handle leading misaligned bytes
@@ -865,7 +1199,7 @@ uint32_t crc32cSlicingBy16(const void* data, size_t length, uint32_t crc) {
     }
 
     length -= initial_bytes;
-    size_t running_length = length & ~(sizeof(uint64_t) - 1);
+    size_t running_length = length & ~(size_t(16) - 1);
     size_t end_bytes = length - running_length;
 
     for (size_t li = 0; li < running_length/16; li++) {
@@ -915,6 +1249,7 @@ uint32_t crc32cSlicingBy16(const void* data, size_t length, uint32_t crc) {
 }
 
 uint32_t crc32cSlicingBy32(const void* data, size_t length, uint32_t crc) {
+    CRC32_STATS_RECORD(crc32cSlicingBy32, data, length);
     const char* p_buf = (const char*) data;
 
     // Handle leading misaligned bytes
@@ -925,7 +1260,7 @@ uint32_t crc32cSlicingBy32(const void* data, size_t length, uint32_t crc) {
     }
 
     length -= initial_bytes;
-    size_t running_length = length & ~(sizeof(uint64_t) - 1);
+    size_t running_length = length & ~(size_t(32) - 1);
     size_t end_bytes = length - running_length;
 
     for (size_t li = 0; li < running_length/32; li++) {
@@ -1010,216 +1345,4242 @@ uint32_t crc32cSlicingBy32(const void* data, size_t length, uint32_t crc) {
     return crc;
 }
 
-// //////////////////////////////////////////////////////////
-// constants
+/// CRC32C with the same conventions as crc32_xx (pre/post inversion, chaining via previousCrc32)
+uint32_t crc32c_16bytes(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  return ~crc32cSlicingBy16(data, length, ~previousCrc32);
+}
 
-void init()
+/// compute CRC32C (half-byte algorithm, 64 bytes of tables)
+uint32_t crc32c_halfbyte(const void* data, size_t length, uint32_t previousCrc32 = 0)
 {
-  // same algorithm as crc32_bitwise
-  for (int i = 0; i <= 0xFF; i++)
+  CRC32_STATS_RECORD(crc32c_halfbyte, data, length);
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint8_t* current = (const uint8_t*) data;
+
+  /// look-up table for half-byte, same as crc_tableil8_o32[16*i]
+  static const uint32_t Crc32cLookup16[16] =
   {
-    uint32_t crc = i;
-    for (int j = 0; j < 8; j++)
-      crc = (crc >> 1) ^ ((crc & 1) * Polynomial);
-    Crc32Lookup[0][i] = crc;
+    0x00000000,0x105EC76F,0x20BD8EDE,0x30E349B1,0x417B1DBC,0x5125DAD3,0x61C69362,0x7198540D,
+    0x82F63B78,0x92A8FC17,0xA24BB5A6,0xB21572C9,0xC38D26C4,0xD3D3E1AB,0xE330A81A,0xF36E6F75
+  };
+
+  while (length-- > 0)
+  {
+    crc = Crc32cLookup16[(crc ^  *current      ) & 0x0F] ^ (crc >> 4);
+    crc = Crc32cLookup16[(crc ^ (*current >> 4)) & 0x0F] ^ (crc >> 4);
+    current++;
   }
-  // ... and the following slicing-by-8 algorithm (from Intel):
-  // http://www.intel.com/technology/comms/perfnet/download/CRC_generators.pdf
-  // http://sourceforge.net/projects/slicing-by-8/
-  for (int i = 0; i <= 0xFF; i++)
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+#define CRC32_SSE42 1
+#include <nmmintrin.h>
+
+/// compute CRC32C (SSE4.2 crc32 instruction)
+uint32_t crc32c_sse42(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32c_sse42, data, length);
+  uint64_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint8_t* current = (const uint8_t*) data;
+
+  while (length >= 8)
   {
-    for (int j=0; j<15; j++)
-      Crc32Lookup[j+1][i] = (Crc32Lookup[j][i] >> 8) ^ Crc32Lookup[0][Crc32Lookup[j][i] & 0xFF];
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) current);
+    current += 8;
+    length  -= 8;
   }
+  while (length-- > 0)
+    crc = _mm_crc32_u8(uint32_t(crc), *current++);
+
+  return ~uint32_t(crc);
 }
+#endif
+
 
 // //////////////////////////////////////////////////////////
-// test code
+// CRC32C of many equal-sized blocks (storage pages), one CRC per block
+// three blocks are processed in lockstep: their dependency chains are independent,
+// so the CPU overlaps them (crc32 instruction: latency 3, throughput 1 per cycle)
 
+/// one slicing-by-8 step, same tables as crc32cSlicingBy8
+static inline uint32_t crc32c_step8(uint32_t crc, const uint8_t* current)
+{
+  uint32_t one = *(const uint32_t*) current ^ crc;
+  uint32_t two = *(const uint32_t*) (current + 4);
+  return crc_tableil8_o88[ one      & 0xFF] ^ crc_tableil8_o80[(one>> 8) & 0xFF] ^
+         crc_tableil8_o72[(one>>16) & 0xFF] ^ crc_tableil8_o64[ one>>24        ] ^
+         crc_tableil8_o56[ two      & 0xFF] ^ crc_tableil8_o48[(two>> 8) & 0xFF] ^
+         crc_tableil8_o40[(two>>16) & 0xFF] ^ crc_tableil8_o32[ two>>24        ];
+}
 
-/// one gigabyte
-const size_t NumBytes = 1024*1024*1024;
-/// 4k chunks during last test
-const size_t DefaultChunkSize = 4*1024;
+/// table lanes, inlined into crc32c_blocks_tables with constant blockSize
+static inline void crc32c_blocks_tables_impl(const uint8_t* data, size_t blockSize, size_t numBlocks, uint32_t* crcs)
+{
+  size_t block = 0;
+  for (; block + 3 <= numBlocks; block += 3)
+  {
+    const uint8_t* a = data + (block    ) * blockSize;
+    const uint8_t* b = data + (block + 1) * blockSize;
+    const uint8_t* c = data + (block + 2) * blockSize;
+    uint32_t crcA = 0xFFFFFFFF, crcB = 0xFFFFFFFF, crcC = 0xFFFFFFFF;
+    size_t i = 0;
+    for (; i + 8 <= blockSize; i += 8)
+    {
+      crcA = crc32c_step8(crcA, a + i);
+      crcB = crc32c_step8(crcB, b + i);
+      crcC = crc32c_step8(crcC, c + i);
+    }
+    for (; i < blockSize; i++)
+    {
+      crcA = crc_tableil8_o32[(crcA ^ a[i]) & 0xFF] ^ (crcA >> 8);
+      crcB = crc_tableil8_o32[(crcB ^ b[i]) & 0xFF] ^ (crcB >> 8);
+      crcC = crc_tableil8_o32[(crcC ^ c[i]) & 0xFF] ^ (crcC >> 8);
+    }
+    crcs[block] = ~crcA, crcs[block + 1] = ~crcB, crcs[block + 2] = ~crcC;
+  }
+  // last one or two blocks, one lane (no call to a kernel that would count them again in the stats)
+  for (; block < numBlocks; block++)
+  {
+    const uint8_t* a = data + block * blockSize;
+    uint32_t crcA = 0xFFFFFFFF;
+    size_t i = 0;
+    for (; i + 8 <= blockSize; i += 8)
+      crcA = crc32c_step8(crcA, a + i);
+    for (; i < blockSize; i++)
+      crcA = crc_tableil8_o32[(crcA ^ a[i]) & 0xFF] ^ (crcA >> 8);
+    crcs[block] = ~crcA;
+  }
+}
 
+/// CRC32C of numBlocks consecutive blocks of blockSize bytes (table lanes, no special instructions)
+void crc32c_blocks_tables(const void* data, size_t blockSize, size_t numBlocks, uint32_t* crcs)
+{
+  const uint8_t* current = (const uint8_t*) data;
+  // constant block sizes let the compiler unroll the inner loops
+  switch (blockSize)
+  {
+    case   512: crc32c_blocks_tables_impl(current,   512, numBlocks, crcs); break;
+    case  4096: crc32c_blocks_tables_impl(current,  4096, numBlocks, crcs); break;
+    case 65536: crc32c_blocks_tables_impl(current, 65536, numBlocks, crcs); break;
+    default:    crc32c_blocks_tables_impl(current, blockSize, numBlocks, crcs);
+  }
+}
 
-#include <cstdio>
-#include <ctime>
-#ifdef _MSC_VER
-#include <windows.h>
+#ifdef CRC32_SSE42
+/// SSE4.2 lanes, inlined into crc32c_blocks with constant blockSize
+static inline void crc32c_blocks_sse42_impl(const uint8_t* data, size_t blockSize, size_t numBlocks, uint32_t* crcs)
+{
+  size_t block = 0;
+  for (; block + 3 <= numBlocks; block += 3)
+  {
+    const uint8_t* a = data + (block    ) * blockSize;
+    const uint8_t* b = data + (block + 1) * blockSize;
+    const uint8_t* c = data + (block + 2) * blockSize;
+    uint64_t crcA = 0xFFFFFFFF, crcB = 0xFFFFFFFF, crcC = 0xFFFFFFFF;
+    size_t i = 0;
+    for (; i + 8 <= blockSize; i += 8)
+    {
+      crcA = _mm_crc32_u64(crcA, *(const uint64_t*) (a + i));
+      crcB = _mm_crc32_u64(crcB, *(const uint64_t*) (b + i));
+      crcC = _mm_crc32_u64(crcC, *(const uint64_t*) (c + i));
+    }
+    for (; i < blockSize; i++)
+    {
+      crcA = _mm_crc32_u8(uint32_t(crcA), a[i]);
+      crcB = _mm_crc32_u8(uint32_t(crcB), b[i]);
+      crcC = _mm_crc32_u8(uint32_t(crcC), c[i]);
+    }
+    crcs[block] = ~uint32_t(crcA), crcs[block + 1] = ~uint32_t(crcB), crcs[block + 2] = ~uint32_t(crcC);
+  }
+  // last one or two blocks, one lane (no call to a kernel that would count them again in the stats)
+  for (; block < numBlocks; block++)
+  {
+    const uint8_t* a = data + block * blockSize;
+    uint64_t crcA = 0xFFFFFFFF;
+    size_t i = 0;
+    for (; i + 8 <= blockSize; i += 8)
+      crcA = _mm_crc32_u64(crcA, *(const uint64_t*) (a + i));
+    for (; i < blockSize; i++)
+      crcA = _mm_crc32_u8(uint32_t(crcA), a[i]);
+    crcs[block] = ~uint32_t(crcA);
+  }
+}
 #endif
 
-// timing
-static double seconds()
+/// CRC32C of numBlocks consecutive blocks of blockSize bytes (SSE4.2 if compiled in, else table lanes)
+void crc32c_blocks(const void* data, size_t blockSize, size_t numBlocks, uint32_t* crcs)
 {
-#ifdef _MSC_VER
-  LARGE_INTEGER frequency, now;
-  QueryPerformanceFrequency(&frequency);
-  QueryPerformanceCounter  (&now);
-  return now.QuadPart / double(frequency.QuadPart);
+  CRC32_STATS_RECORD(crc32c_blocks, data, uint64_t(blockSize) * numBlocks);
+#ifdef CRC32_SSE42
+  const uint8_t* current = (const uint8_t*) data;
+  switch (blockSize)
+  {
+    case   512: crc32c_blocks_sse42_impl(current,   512, numBlocks, crcs); break;
+    case  4096: crc32c_blocks_sse42_impl(current,  4096, numBlocks, crcs); break;
+    case 65536: crc32c_blocks_sse42_impl(current, 65536, numBlocks, crcs); break;
+    default:    crc32c_blocks_sse42_impl(current, blockSize, numBlocks, crcs);
+  }
 #else
-  return clock() / double(CLOCKS_PER_SEC);
+  crc32c_blocks_tables(data, blockSize, numBlocks, crcs);
 #endif
 }
 
+// //////////////////////////////////////////////////////////
+// bulk hashing of fixed-width key columns (hash joins, aggregation):
+// hash = CRC32C of the key starting from seed without pre/post inversion,
+// i.e. exactly what _mm_crc32_u32(seed, key) / _mm_crc32_u64(seed, key) return
 
-int main(int, char**)
+/// CRC32C step over 4 bytes (table version of _mm_crc32_u32)
+static inline uint32_t crc32c_hash_step4(uint32_t crc, uint32_t value)
 {
-  printf("Please wait ...\n");
-  init();
-
-  // initialize
-  char* data = new char[NumBytes];
-  for (size_t i = 0; i < NumBytes; i++)
-    data[i] = char(i & 0xFF);
+  crc ^= value;
+  return crc_tableil8_o56[ crc        & 0xFF] ^
+         crc_tableil8_o48[(crc >>  8) & 0xFF] ^
+         crc_tableil8_o40[(crc >> 16) & 0xFF] ^
+         crc_tableil8_o32[ crc >> 24        ];
+}
 
-  // re-use variables
-  double startTime, duration;
-  uint32_t crc;
-/*
-  // bitwise
-  startTime = seconds();
-  crc = crc32_bitwise(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf("bitwise        : CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// CRC32C step over 8 bytes (table version of _mm_crc32_u64)
+static inline uint32_t crc32c_hash_step8(uint32_t crc, uint64_t value)
+{
+  uint32_t one = uint32_t(value) ^ crc;
+  uint32_t two = uint32_t(value >> 32);
+  return crc_tableil8_o88[ one        & 0xFF] ^
+         crc_tableil8_o80[(one >>  8) & 0xFF] ^
+         crc_tableil8_o72[(one >> 16) & 0xFF] ^
+         crc_tableil8_o64[ one >> 24        ] ^
+         crc_tableil8_o56[ two        & 0xFF] ^
+         crc_tableil8_o48[(two >>  8) & 0xFF] ^
+         crc_tableil8_o40[(two >> 16) & 0xFF] ^
+         crc_tableil8_o32[ two >> 24        ];
+}
 
-  // half-byte
-  startTime = seconds();
-  crc = crc32_halfbyte(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf("half-byte      : CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
-*/
-  // eight bytes at once
-  startTime = seconds();
-  crc = crc32_88bytes(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf(" 88 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// hash a column of 32-bit keys, four independent lanes per iteration
+void crc32c_hash_u32(const uint32_t* keys, size_t numKeys, uint32_t seed, uint32_t* hashes)
+{
+  CRC32_STATS_RECORD(crc32c_hash_u32, keys, numKeys * 4);
+  size_t i = 0;
+#ifdef CRC32_SSE42
+  for (; i + 4 <= numKeys; i += 4)
+  {
+    hashes[i    ] = _mm_crc32_u32(seed, keys[i    ]);
+    hashes[i + 1] = _mm_crc32_u32(seed, keys[i + 1]);
+    hashes[i + 2] = _mm_crc32_u32(seed, keys[i + 2]);
+    hashes[i + 3] = _mm_crc32_u32(seed, keys[i + 3]);
+  }
+  for (; i < numKeys; i++)
+    hashes[i] = _mm_crc32_u32(seed, keys[i]);
+#else
+  for (; i < numKeys; i++)
+    hashes[i] = crc32c_hash_step4(seed, keys[i]);
+#endif
+}
 
-  // one byte at once
-  startTime = seconds();
-  crc = crc32_1byte(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf("  1 byte  at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// hash a column of 64-bit keys, four independent lanes per iteration
+void crc32c_hash_u64(const uint64_t* keys, size_t numKeys, uint32_t seed, uint32_t* hashes)
+{
+  CRC32_STATS_RECORD(crc32c_hash_u64, keys, numKeys * 8);
+  size_t i = 0;
+#ifdef CRC32_SSE42
+  for (; i + 4 <= numKeys; i += 4)
+  {
+    hashes[i    ] = uint32_t(_mm_crc32_u64(seed, keys[i    ]));
+    hashes[i + 1] = uint32_t(_mm_crc32_u64(seed, keys[i + 1]));
+    hashes[i + 2] = uint32_t(_mm_crc32_u64(seed, keys[i + 2]));
+    hashes[i + 3] = uint32_t(_mm_crc32_u64(seed, keys[i + 3]));
+  }
+  for (; i < numKeys; i++)
+    hashes[i] = uint32_t(_mm_crc32_u64(seed, keys[i]));
+#else
+  for (; i < numKeys; i++)
+    hashes[i] = crc32c_hash_step8(seed, keys[i]);
+#endif
+}
 
-  // four bytes at once
-  startTime = seconds();
-  crc = crc32cSlicingBy4(data, NumBytes, 0);
-  duration  = seconds() - startTime;
-  printf("+  4 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// hash a column of 16-byte keys (e.g. UUIDs or pairs of 64-bit columns), stored back to back
+void crc32c_hash_u128(const void* keys, size_t numKeys, uint32_t seed, uint32_t* hashes)
+{
+  CRC32_STATS_RECORD(crc32c_hash_u128, keys, numKeys * 16);
+  const uint64_t* current = (const uint64_t*) keys;
+  size_t i = 0;
+#ifdef CRC32_SSE42
+  for (; i + 4 <= numKeys; i += 4, current += 8)
+  {
+    uint64_t a = _mm_crc32_u64(seed, current[0]);
+    uint64_t b = _mm_crc32_u64(seed, current[2]);
+    uint64_t c = _mm_crc32_u64(seed, current[4]);
+    uint64_t d = _mm_crc32_u64(seed, current[6]);
+    hashes[i    ] = uint32_t(_mm_crc32_u64(a, current[1]));
+    hashes[i + 1] = uint32_t(_mm_crc32_u64(b, current[3]));
+    hashes[i + 2] = uint32_t(_mm_crc32_u64(c, current[5]));
+    hashes[i + 3] = uint32_t(_mm_crc32_u64(d, current[7]));
+  }
+  for (; i < numKeys; i++, current += 2)
+    hashes[i] = uint32_t(_mm_crc32_u64(_mm_crc32_u64(seed, current[0]), current[1]));
+#else
+  for (; i < numKeys; i++, current += 2)
+    hashes[i] = crc32c_hash_step8(crc32c_hash_step8(seed, current[0]), current[1]);
+#endif
+}
 
-  // four bytes at once
-  startTime = seconds();
-  crc = crc32cSlicingBy2x4(data, NumBytes, 0);
-  duration  = seconds() - startTime;
-  printf("+2*4 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
 
-  // four bytes at once
-  startTime = seconds();
-  crc = crc32cSlicingBy4x4(data, NumBytes, 0);
-  duration  = seconds() - startTime;
-  printf("+4*4 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+// //////////////////////////////////////////////////////////
+// combine CRCs of adjacent blocks (same math as zlib's crc32_combine)
 
-  // four bytes at once
-  startTime = seconds();
-  crc = crc32cSlicingBy8(data, NumBytes, 0);
-  duration  = seconds() - startTime;
-  printf("+  8 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// x^(2^n) modulo each polynomial, filled by init()
+uint32_t Crc32Powers[32], Crc32cPowers[32];
 
-  // four bytes at once
-  startTime = seconds();
-  crc = crc32cSlicingBy16(data, NumBytes, 0);
-  duration  = seconds() - startTime;
-  printf("+2*8 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// multiply a and b modulo the (reflected) polynomial
+static uint32_t multmodp(uint32_t a, uint32_t b, uint32_t poly)
+{
+  uint32_t m = 1u << 31, p = 0;
+  for (;;)
+  {
+    if (a & m)
+    {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+        break;
+    }
+    m >>= 1;
+    b = (b >> 1) ^ (-int32_t(b & 1) & poly);
+  }
+  return p;
+}
 
-  // four bytes at once
-  startTime = seconds();
-  crc = crc32cSlicingBy32(data, NumBytes, 0);
-  duration  = seconds() - startTime;
-  printf("+4*8 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// x^(n*2^k) modulo the polynomial
+static uint32_t x2nmodp(uint64_t n, unsigned k, const uint32_t* powers, uint32_t poly)
+{
+  uint32_t p = 1u << 31; // x^0
+  while (n)
+  {
+    if (n & 1)
+      p = multmodp(powers[k & 31], p, poly);
+    n >>= 1;
+    k++;
+  }
+  return p;
+}
 
-  // four bytes at once
-  startTime = seconds();
-  crc = crc32_4bytes(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf("  4 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// CRC32 of A+B, given CRC32 of A, CRC32 of B and length of B
+/// (works both for crc32_xx results and raw crc32cSlicingByXX-style values chained from 0)
+uint32_t crc32_combine(uint32_t crcA, uint32_t crcB, uint64_t lengthB)
+{
+  return multmodp(x2nmodp(lengthB, 3, Crc32Powers, Polynomial), crcA, Polynomial) ^ crcB;
+}
 
-  // four bytes at once
-  startTime = seconds();
-  crc = crc32_2x4bytes(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf("2*4 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// same for CRC32C
+uint32_t crc32c_combine(uint32_t crcA, uint32_t crcB, uint64_t lengthB)
+{
+  return multmodp(x2nmodp(lengthB, 3, Crc32cPowers, PolynomialCastagnoli), crcA, PolynomialCastagnoli) ^ crcB;
+}
 
-  // four bytes at once
-  startTime = seconds();
-  crc = crc32_4x4bytes(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf("4*4 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// CRC of the XOR of count blocks of equal length, given only their CRCs: a CRC is linear in the data plus
+/// the CRC of length zero bytes, so that constant cancels out for each pair of blocks
+static uint32_t crc_xor(const uint32_t* crcs, size_t count, uint64_t length, uint32_t previousCrc32,
+                        const uint32_t* powers, uint32_t poly)
+{
+  uint32_t result = 0;
+  for (size_t i = 0; i < count; i++)
+    result ^= crcs[i];
+  // odd number of blocks (or none at all): one constant left over / missing
+  if ((count & 1) == 0)
+    result ^= ~multmodp(x2nmodp(length, 3, powers, poly), ~previousCrc32, poly); // CRC of length zeros
+  return result;
+}
 
-  // eight bytes at once
-  startTime = seconds();
-  crc = crc32_8bytes(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf("  8 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// CRC32 of a parity block (XOR of count data blocks of length bytes) from the CRC32s of the data blocks,
+/// all of them computed with the same previousCrc32 (0 = stand-alone blocks)
+uint32_t crc32_xor(const uint32_t* crcs, size_t count, uint64_t length, uint32_t previousCrc32 = 0)
+{
+  return crc_xor(crcs, count, length, previousCrc32, Crc32Powers, Polynomial);
+}
 
-  // eight bytes at once
-  startTime = seconds();
-  crc = crc32_16bytes(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf(" 16 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+/// same for CRC32C
+uint32_t crc32c_xor(const uint32_t* crcs, size_t count, uint64_t length, uint32_t previousCrc32 = 0)
+{
+  return crc_xor(crcs, count, length, previousCrc32, Crc32cPowers, PolynomialCastagnoli);
+}
 
-  // eight bytes at once
-  startTime = seconds();
-  crc = crc32_2x16bytes(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf("2*16 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
 
-  // eight bytes at once
-  startTime = seconds();
-  crc = crc32_2x8bytes(data, NumBytes);
-  duration  = seconds() - startTime;
-  printf("2*8 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+// //////////////////////////////////////////////////////////
+// software prefetching for DRAM-resident buffers:
+// each loop iteration consumes one cache line and prefetches the line Crc32PrefetchDistance bytes ahead,
+// the _nta variants use a non-temporal hint so that the message doesn't evict the application's data
 
-  // eight bytes at once
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// prefetch distance of the *_prefetch kernels in bytes, 0 disables prefetching
+size_t Crc32PrefetchDistance = 1024;
+
+/// prefetch the cache line containing address into all levels or, if nta, with a non-temporal hint
+static inline void crc32_prefetch(const void* address, bool nta)
+{
+#if defined(__GNUC__)
+  if (nta)
+    __builtin_prefetch(address, 0, 0);
+  else
+    __builtin_prefetch(address, 0, 3);
+#elif defined(_MSC_VER)
+  if (nta)
+    _mm_prefetch((const char*) address, _MM_HINT_NTA);
+  else
+    _mm_prefetch((const char*) address, _MM_HINT_T0);
+#endif
+}
+
+/// Slicing-by-16, four steps per cache line
+static inline uint32_t crc32_16bytes_prefetch_impl(const void* data, size_t length, uint32_t previousCrc32, bool nta)
+{
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint32_t* current = (const uint32_t*) data;
+  const size_t distance = Crc32PrefetchDistance;
+
+  for (; length >= 64; length -= 64, current += 16)
+  {
+    if (distance)
+      crc32_prefetch((const char*) current + distance, nta);
+    crc = crc32_slice16(Crc32Lookup, current,      crc);
+    crc = crc32_slice16(Crc32Lookup, current +  4, crc);
+    crc = crc32_slice16(Crc32Lookup, current +  8, crc);
+    crc = crc32_slice16(Crc32Lookup, current + 12, crc);
+  }
+  for (; length >= 16; length -= 16, current += 4)
+    crc = crc32_slice16(Crc32Lookup, current, crc);
+
+  const uint8_t* currentChar = (const uint8_t*) current;
+  // remaining 1 to 15 bytes (standard algorithm)
+  while (length-- > 0)
+    crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *currentChar++];
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+/// compute CRC32 (Slicing-by-16 algorithm with software prefetching)
+uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32_16bytes_prefetch, data, length);
+  return crc32_16bytes_prefetch_impl(data, length, previousCrc32, false);
+}
+
+/// compute CRC32 (Slicing-by-16 algorithm with non-temporal software prefetching)
+uint32_t crc32_16bytes_prefetch_nta(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32_16bytes_prefetch_nta, data, length);
+  return crc32_16bytes_prefetch_impl(data, length, previousCrc32, true);
+}
+
+#ifdef CRC32_SSE42
+/// SSE4.2 crc32 instruction, eight of them per cache line
+static inline uint32_t crc32c_sse42_prefetch_impl(const void* data, size_t length, uint32_t previousCrc32, bool nta)
+{
+  uint64_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint8_t* current = (const uint8_t*) data;
+  const size_t distance = Crc32PrefetchDistance;
+
+  for (; length >= 64; length -= 64, current += 64)
+  {
+    if (distance)
+      crc32_prefetch(current + distance, nta);
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) (current     ));
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) (current +  8));
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) (current + 16));
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) (current + 24));
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) (current + 32));
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) (current + 40));
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) (current + 48));
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) (current + 56));
+  }
+  for (; length >= 8; length -= 8, current += 8)
+    crc = _mm_crc32_u64(crc, *(const uint64_t*) current);
+  while (length-- > 0)
+    crc = _mm_crc32_u8(uint32_t(crc), *current++);
+
+  return ~uint32_t(crc);
+}
+
+/// compute CRC32C (SSE4.2 with software prefetching)
+uint32_t crc32c_sse42_prefetch(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32c_sse42_prefetch, data, length);
+  return crc32c_sse42_prefetch_impl(data, length, previousCrc32, false);
+}
+
+/// compute CRC32C (SSE4.2 with non-temporal software prefetching)
+uint32_t crc32c_sse42_prefetch_nta(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32c_sse42_prefetch_nta, data, length);
+  return crc32c_sse42_prefetch_impl(data, length, previousCrc32, true);
+}
+#endif
+
+
+// //////////////////////////////////////////////////////////
+// small-footprint kernels for cache-constrained deployments
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+
+/// compute CRC32 (half-byte algorithm, 4 interleaved SSSE3 lanes)
+/// the 64-byte half-byte table lives in four registers and is read with pshufb,
+/// the buffer is split into four parts whose CRCs are glued like crc32_combine
+uint32_t crc32_halfbyte_simd(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  // combining costs a few hundred cycles, not worth it for short messages
+  if (length < 256)
+    return crc32_halfbyte(data, length, previousCrc32);
+  CRC32_STATS_RECORD(crc32_halfbyte_simd, data, length);
+
+  // byte j of all 16 table entries
+  uint8_t bytes[4][16];
+  for (int i = 0; i < 16; i++)
+    for (int j = 0; j < 4; j++)
+      bytes[j][i] = uint8_t(Crc32Lookup16[i] >> (8*j));
+  const __m128i table0 = _mm_loadu_si128((const __m128i*) bytes[0]);
+  const __m128i table1 = _mm_loadu_si128((const __m128i*) bytes[1]);
+  const __m128i table2 = _mm_loadu_si128((const __m128i*) bytes[2]);
+  const __m128i table3 = _mm_loadu_si128((const __m128i*) bytes[3]);
+  // copy each lane's nibble to all four bytes of the lane; 0x80 makes pshufb return 0
+  const __m128i nibble  = _mm_set1_epi32(0x0F);
+  const __m128i spread  = _mm_setr_epi8(0,0,0,0, 4,4,4,4, 8,8,8,8, 12,12,12,12);
+  const __m128i select0 = _mm_set1_epi32(int(0x80808000));
+  const __m128i select1 = _mm_set1_epi32(int(0x80800080));
+  const __m128i select2 = _mm_set1_epi32(int(0x80008080));
+  const __m128i select3 = _mm_set1_epi32(int(0x00808080));
+
+  const size_t   part = (length / 16) * 4;
+  const uint8_t* current = (const uint8_t*) data;
+  __m128i crc = _mm_setr_epi32(int(~previousCrc32), -1, -1, -1);
+  for (size_t i = 0; i < part; i += 4)
+  {
+    __m128i words = _mm_setr_epi32(*(const int32_t*) (current +          i),
+                                   *(const int32_t*) (current +   part + i),
+                                   *(const int32_t*) (current + 2*part + i),
+                                   *(const int32_t*) (current + 3*part + i));
+    crc = _mm_xor_si128(crc, words);
+    for (int n = 0; n < 8; n++)
+    {
+      __m128i index = _mm_shuffle_epi8(_mm_and_si128(crc, nibble), spread);
+      __m128i entry = _mm_xor_si128(
+          _mm_xor_si128(_mm_shuffle_epi8(table0, _mm_or_si128(index, select0)),
+                        _mm_shuffle_epi8(table1, _mm_or_si128(index, select1))),
+          _mm_xor_si128(_mm_shuffle_epi8(table2, _mm_or_si128(index, select2)),
+                        _mm_shuffle_epi8(table3, _mm_or_si128(index, select3))));
+      crc = _mm_xor_si128(_mm_srli_epi32(crc, 4), entry);
+    }
+  }
+
+  uint32_t lanes[4];
+  _mm_storeu_si128((__m128i*) lanes, crc);
+  // all parts have the same length: one shift operator for all of them
+  uint32_t shift  = x2nmodp(part, 3, Crc32Powers, Polynomial);
+  uint32_t result = ~lanes[0];
+  for (int lane = 1; lane < 4; lane++)
+    result = multmodp(shift, result, Polynomial) ^ ~lanes[lane];
+
+  // remaining 0 to 15 bytes (inline, not a crc32_halfbyte call that the stats would count as well)
+  uint32_t crc32 = ~result;
+  for (current += 4*part, length -= 4*part; length > 0; length--, current++)
+  {
+    crc32 = Crc32Lookup16[(crc32 ^  *current      ) & 0x0F] ^ (crc32 >> 4);
+    crc32 = Crc32Lookup16[(crc32 ^ (*current >> 4)) & 0x0F] ^ (crc32 >> 4);
+  }
+
+  return ~crc32; // same as crc ^ 0xFFFFFFFF
+}
+#endif
+
+
+// //////////////////////////////////////////////////////////
+// alternative table layouts (compile with -DCRC32_TABLE_LAYOUTS, always on in the benchmark)
+// - interleaved [256][16]: all 16 slices of one byte value share a 64-byte cache line
+// - a copy of Crc32Lookup on a 2 MB page: one TLB entry for all tables
+// - 16-bit indexed tables (256 KB each, on the same huge page): half the lookups per byte
+
+#ifdef CRC32_TABLE_LAYOUTS
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/// Crc32LookupInterleaved[byte][slice] = Crc32Lookup[slice][byte]
+alignas(64) uint32_t Crc32LookupInterleaved[256][16];
+/// copy of Crc32Lookup on the huge page (points to Crc32Lookup if allocation failed)
+uint32_t (*Crc32LookupHuge)[256] = Crc32Lookup;
+/// Crc32Lookup16bit[k][x] = Crc32Lookup[2k+1][x & 0xFF] ^ Crc32Lookup[2k][x >> 8], on the huge page
+uint32_t (*Crc32Lookup16bit)[65536] = NULL;
+
+/// where the huge-page tables live, for the benchmark
+const char* Crc32HugeTablesKind = "not allocated";
+void*       Crc32HugeTables     = NULL;
+const size_t Crc32HugeTablesSize = sizeof(uint32_t[16][256]) + sizeof(uint32_t[4][65536]);
+
+/// 2 MB-aligned memory: explicit huge page, else transparent huge page, else plain 64-byte aligned heap
+static void* crc32_alloc_huge(size_t size, const char*& kind)
+{
+  const size_t HugePage = 2*1024*1024;
+  size_t rounded = (size + HugePage - 1) & ~(HugePage - 1);
+#ifdef __linux__
+#ifdef MAP_HUGETLB
+  void* memory = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (memory != MAP_FAILED)
+  {
+    kind = "2 MB page (MAP_HUGETLB)";
+    return memory;
+  }
+#endif
+  // over-allocate, trim to a 2 MB boundary and ask for a transparent huge page
+  char* raw = (char*) mmap(NULL, rounded + HugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw != MAP_FAILED)
+  {
+    char* aligned = (char*) ((uintptr_t(raw) + HugePage - 1) & ~uintptr_t(HugePage - 1));
+    if (aligned > raw)
+      munmap(raw, aligned - raw);
+    munmap(aligned + rounded, raw + HugePage - aligned);
+#ifdef MADV_HUGEPAGE
+    if (madvise(aligned, rounded, MADV_HUGEPAGE) == 0)
+    {
+      kind = "transparent huge page (MADV_HUGEPAGE)";
+      return aligned;
+    }
+#endif
+    kind = "4 KB pages";
+    return aligned;
+  }
+#endif
+  // never freed: the tables live as long as the process
+  char* heap = (char*) malloc(size + 64);
+  if (!heap)
+    return NULL;
+  kind = "heap";
+  return (void*) ((uintptr_t(heap) + 63) & ~uintptr_t(63));
+}
+
+/// build the alternative layouts from Crc32Lookup, called by init()
+static void initTableLayouts()
+{
+  for (int i = 0; i <= 0xFF; i++)
+    for (int slice = 0; slice < 16; slice++)
+      Crc32LookupInterleaved[i][slice] = Crc32Lookup[slice][i];
+
+  if (Crc32HugeTables)
+    return;
+  Crc32HugeTables = crc32_alloc_huge(Crc32HugeTablesSize, Crc32HugeTablesKind);
+  if (!Crc32HugeTables)
+    return;
+  Crc32LookupHuge  = (uint32_t (*)[256])   Crc32HugeTables;
+  Crc32Lookup16bit = (uint32_t (*)[65536]) ((char*) Crc32HugeTables + sizeof(uint32_t[16][256]));
+  memcpy(Crc32LookupHuge, Crc32Lookup, sizeof(Crc32Lookup));
+  for (int k = 0; k < 4; k++)
+    for (uint32_t x = 0; x <= 0xFFFF; x++)
+      Crc32Lookup16bit[k][x] = Crc32Lookup[2*k+1][x & 0xFF] ^ Crc32Lookup[2*k][x >> 8];
+}
+
+
+/// same with the interleaved [256][16] table
+static inline uint32_t crc32_slice16_interleaved(const uint32_t* current, uint32_t crc)
+{
+  uint32_t one = current[0] ^ crc;
+  uint32_t two = current[1];
+  uint32_t a3  = current[2];
+  uint32_t a4  = current[3];
+  return Crc32LookupInterleaved[( a4>>24) & 0xFF][ 0] ^
+         Crc32LookupInterleaved[( a4>>16) & 0xFF][ 1] ^
+         Crc32LookupInterleaved[( a4>> 8) & 0xFF][ 2] ^
+         Crc32LookupInterleaved[  a4      & 0xFF][ 3] ^
+         Crc32LookupInterleaved[( a3>>24) & 0xFF][ 4] ^
+         Crc32LookupInterleaved[( a3>>16) & 0xFF][ 5] ^
+         Crc32LookupInterleaved[( a3>> 8) & 0xFF][ 6] ^
+         Crc32LookupInterleaved[  a3      & 0xFF][ 7] ^
+         Crc32LookupInterleaved[(two>>24) & 0xFF][ 8] ^
+         Crc32LookupInterleaved[(two>>16) & 0xFF][ 9] ^
+         Crc32LookupInterleaved[(two>> 8) & 0xFF][10] ^
+         Crc32LookupInterleaved[ two      & 0xFF][11] ^
+         Crc32LookupInterleaved[(one>>24) & 0xFF][12] ^
+         Crc32LookupInterleaved[(one>>16) & 0xFF][13] ^
+         Crc32LookupInterleaved[(one>> 8) & 0xFF][14] ^
+         Crc32LookupInterleaved[ one      & 0xFF][15];
+}
+
+
+/// compute CRC32 (Slicing-by-16 algorithm, interleaved [256][16] table)
+uint32_t crc32_16bytes_interleaved(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32_16bytes_interleaved, data, length);
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint32_t* current = (const uint32_t*) data;
+
+  for (; length >= 16; length -= 16, current += 4)
+    crc = crc32_slice16_interleaved(current, crc);
+
+  const uint8_t* currentChar = (const uint8_t*) current;
+  // remaining 1 to 15 bytes (standard algorithm)
+  while (length-- > 0)
+    crc = (crc >> 8) ^ Crc32LookupInterleaved[(crc & 0xFF) ^ *currentChar++][0];
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+
+/// compute CRC32 (Slicing-by-16 algorithm, unrolled twice, interleaved [256][16] table)
+uint32_t crc32_2x16bytes_interleaved(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32_2x16bytes_interleaved, data, length);
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint32_t* current = (const uint32_t*) data;
+
+  for (; length >= 32; length -= 32, current += 8)
+  {
+    crc = crc32_slice16_interleaved(current,     crc);
+    crc = crc32_slice16_interleaved(current + 4, crc);
+  }
+  if (length >= 16)
+  {
+    crc = crc32_slice16_interleaved(current, crc);
+    length -= 16, current += 4;
+  }
+
+  const uint8_t* currentChar = (const uint8_t*) current;
+  // remaining 1 to 15 bytes (standard algorithm)
+  while (length-- > 0)
+    crc = (crc >> 8) ^ Crc32LookupInterleaved[(crc & 0xFF) ^ *currentChar++][0];
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+
+/// compute CRC32 (Slicing-by-16 algorithm, copy of Crc32Lookup on a huge page)
+uint32_t crc32_16bytes_huge(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32_16bytes_huge, data, length);
+  const uint32_t (*table)[256] = Crc32LookupHuge;
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint32_t* current = (const uint32_t*) data;
+
+  for (; length >= 16; length -= 16, current += 4)
+    crc = crc32_slice16(table, current, crc);
+
+  const uint8_t* currentChar = (const uint8_t*) current;
+  // remaining 1 to 15 bytes (standard algorithm)
+  while (length-- > 0)
+    crc = (crc >> 8) ^ table[0][(crc & 0xFF) ^ *currentChar++];
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+
+/// compute CRC32 (Slicing-by-16 algorithm, unrolled twice, copy of Crc32Lookup on a huge page)
+uint32_t crc32_2x16bytes_huge(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32_2x16bytes_huge, data, length);
+  const uint32_t (*table)[256] = Crc32LookupHuge;
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint32_t* current = (const uint32_t*) data;
+
+  for (; length >= 32; length -= 32, current += 8)
+  {
+    crc = crc32_slice16(table, current,     crc);
+    crc = crc32_slice16(table, current + 4, crc);
+  }
+  if (length >= 16)
+  {
+    crc = crc32_slice16(table, current, crc);
+    length -= 16, current += 4;
+  }
+
+  const uint8_t* currentChar = (const uint8_t*) current;
+  // remaining 1 to 15 bytes (standard algorithm)
+  while (length-- > 0)
+    crc = (crc >> 8) ^ table[0][(crc & 0xFF) ^ *currentChar++];
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+
+/// compute CRC32 (two bytes per lookup, one 256 KB table)
+uint32_t crc32_2bytes_16bit(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  if (!Crc32Lookup16bit)
+    return crc32_1byte(data, length, previousCrc32);
+  CRC32_STATS_RECORD(crc32_2bytes_16bit, data, length);
+
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint16_t* current = (const uint16_t*) data;
+
+  for (; length >= 2; length -= 2)
+    crc = (crc >> 16) ^ Crc32Lookup16bit[0][(crc ^ *current++) & 0xFFFF];
+
+  // remaining byte
+  if (length)
+    crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *(const uint8_t*) current];
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+
+/// compute CRC32 (Slicing-by-8 algorithm with four 16-bit indexed tables, 1 MB)
+uint32_t crc32_8bytes_16bit(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  if (!Crc32Lookup16bit)
+    return crc32_8bytes(data, length, previousCrc32);
+  CRC32_STATS_RECORD(crc32_8bytes_16bit, data, length);
+
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+  const uint32_t* current = (const uint32_t*) data;
+
+  for (; length >= 8; length -= 8)
+  {
+    uint32_t one = *current++ ^ crc;
+    uint32_t two = *current++;
+    crc = Crc32Lookup16bit[3][one & 0xFFFF] ^
+          Crc32Lookup16bit[2][one >> 16   ] ^
+          Crc32Lookup16bit[1][two & 0xFFFF] ^
+          Crc32Lookup16bit[0][two >> 16   ];
+  }
+
+  const uint16_t* currentWord = (const uint16_t*) current;
+  // remaining 1 to 7 bytes: two at once, then the last one
+  for (; length >= 2; length -= 2)
+    crc = (crc >> 16) ^ Crc32Lookup16bit[0][(crc ^ *currentWord++) & 0xFFFF];
+  if (length)
+    crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *(const uint8_t*) currentWord];
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+#endif // CRC32_TABLE_LAYOUTS
+
+
+// //////////////////////////////////////////////////////////
+// carry-less multiplication (PCLMUL), no lookup tables at all
+// A 16-byte block is folded into the next one with two 64x64-bit carry-less products by x^(128+32) and
+// x^(128-32) mod P, the last 128 bits are reduced to 64 and then to 32 bits (Barrett reduction); see Intel,
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+// crc32_clmul/crc32c_clmul are tuned for 16..256 bytes: there is nothing to warm up, message tails
+// are handled by one overlapping 16-byte load instead of a byte loop, and four blocks are in flight from 64 bytes on.
+
+#if defined(__PCLMUL__) && defined(__SSE4_1__) && defined(__x86_64__)
+#define CRC32_PCLMUL 1
+#include <string.h>
+#include <wmmintrin.h>
+#include <smmintrin.h>
+
+/// bit-reflected constants of a polynomial, [0] multiplies the lower (earlier) half of a block
+struct Crc32ClmulConstants
+{
+  uint64_t fold512[2]; // x^(512+32), x^(512-32) mod P: four blocks ahead
+  uint64_t fold128[2]; // x^(128+32), x^(128-32) mod P: next block
+  uint64_t fold64 [2]; // x^64 mod P
+  uint64_t barrett[2]; // P and mu = x^64 / P
+};
+
+alignas(64) static const Crc32ClmulConstants Crc32Clmul =
+{
+  { 0x0154442bd4, 0x01c6e41596 }, { 0x01751997d0, 0x00ccaa009e }, { 0x0163cd6124, 0 }, { 0x01db710641, 0x01f7011641 }
+};
+alignas(64) static const Crc32ClmulConstants Crc32cClmul =
+{
+  { 0x00740eef02, 0x009e4addf8 }, { 0x00f20c0dfe, 0x014cd00bd6 }, { 0x00dd45aab8, 0 }, { 0x0105ec76f1, 0x00dea713f1 }
+};
+
+/// pshufb masks: 16 bytes at Crc32ClmulShift + n shift a register left by 16 - n bytes,
+/// at Crc32ClmulShift + 16 + n right by n bytes (0x80 = zero)
+alignas(64) static const uint8_t Crc32ClmulShift[48] =
+{
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+/// fold a 128-bit remainder over the next 16 bytes (or over the block 64 bytes ahead with fold512)
+static inline __m128i crc32_clmul_fold(__m128i remainder, __m128i next, __m128i fold)
+{
+  __m128i low  = _mm_clmulepi64_si128(remainder, fold, 0x00);
+  __m128i high = _mm_clmulepi64_si128(remainder, fold, 0x11);
+  return _mm_xor_si128(_mm_xor_si128(high, next), low);
+}
+
+/// Barrett reduction: CRC register after the lower 32 bits of x, XORed with the next 32 bits
+static inline uint32_t crc32_clmul_barrett(__m128i x, const Crc32ClmulConstants& constants)
+{
+  const __m128i low32   = _mm_setr_epi32(~0, 0, ~0, 0);
+  const __m128i barrett = _mm_load_si128((const __m128i*) constants.barrett);
+  __m128i y = _mm_clmulepi64_si128(_mm_and_si128(x, low32), barrett, 0x10);
+  y = _mm_clmulepi64_si128(_mm_and_si128(y, low32), barrett, 0x00);
+  return uint32_t(_mm_extract_epi32(_mm_xor_si128(x, y), 1));
+}
+
+/// 128-bit remainder => 64 bits => 32-bit CRC register (not inverted)
+static inline uint32_t crc32_clmul_reduce(__m128i remainder, const Crc32ClmulConstants& constants)
+{
+  const __m128i fold128 = _mm_load_si128((const __m128i*) constants.fold128);
+  const __m128i low32   = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x = _mm_xor_si128(_mm_srli_si128(remainder, 8), _mm_clmulepi64_si128(remainder, fold128, 0x10));
+  __m128i y = _mm_clmulepi64_si128(_mm_and_si128(x, low32), _mm_loadl_epi64((const __m128i*) constants.fold64), 0x00);
+  return crc32_clmul_barrett(_mm_xor_si128(y, _mm_srli_si128(x, 4)), constants);
+}
+
+/// any length, either polynomial
+static inline uint32_t crc_clmul(const void* data, size_t length, uint32_t previousCrc32, const Crc32ClmulConstants& constants)
+{
+  const uint8_t* current = (const uint8_t*) data;
+  uint32_t crc = ~previousCrc32;
+
+  if (length < 4)
+  {
+    if (length == 0)
+      return previousCrc32;
+    // data and register overlap in one word: its lower bytes go through the polynomial, the rest is shifted
+    uint32_t word = 0;
+    memcpy(&word, current, length);
+    word ^= crc;
+    unsigned bits = 8 * unsigned(length);
+    return ~crc32_clmul_barrett(_mm_setr_epi32(int(word << (32 - bits)), int(word >> bits), 0, 0), constants);
+  }
+  if (length < 16)
+  {
+    // leading zeros don't change the remainder: the message goes to the end of a block,
+    // the register over its first four bytes
+    alignas(16) uint8_t block[16] = { 0 };
+    memcpy(block + 16 - length, current, length);
+    uint32_t head;
+    memcpy(&head, block + 16 - length, 4);
+    head ^= crc;
+    memcpy(block + 16 - length, &head, 4);
+    return ~crc32_clmul_reduce(_mm_load_si128((const __m128i*) block), constants);
+  }
+
+  const __m128i fold128 = _mm_load_si128((const __m128i*) constants.fold128);
+  __m128i remainder = _mm_xor_si128(_mm_loadu_si128((const __m128i*) current), _mm_cvtsi32_si128(int(crc)));
+  if (length >= 64)
+  {
+    // four independent chains, each folded over the block 64 bytes ahead
+    const __m128i fold512 = _mm_load_si128((const __m128i*) constants.fold512);
+    __m128i a = remainder;
+    __m128i b = _mm_loadu_si128((const __m128i*) (current + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*) (current + 32));
+    __m128i d = _mm_loadu_si128((const __m128i*) (current + 48));
+    current += 64;
+    length  -= 64;
+    for (; length >= 64; length -= 64, current += 64)
+    {
+      a = crc32_clmul_fold(a, _mm_loadu_si128((const __m128i*)  current      ), fold512);
+      b = crc32_clmul_fold(b, _mm_loadu_si128((const __m128i*) (current + 16)), fold512);
+      c = crc32_clmul_fold(c, _mm_loadu_si128((const __m128i*) (current + 32)), fold512);
+      d = crc32_clmul_fold(d, _mm_loadu_si128((const __m128i*) (current + 48)), fold512);
+    }
+    remainder = crc32_clmul_fold(crc32_clmul_fold(crc32_clmul_fold(a, b, fold128), c, fold128), d, fold128);
+  }
+  else
+  {
+    current += 16;
+    length  -= 16;
+  }
+  for (; length >= 16; length -= 16, current += 16)
+    remainder = crc32_clmul_fold(remainder, _mm_loadu_si128((const __m128i*) current), fold128);
+
+  // last 1..15 bytes: the message's last 16 bytes overlap the remainder; its first length bytes become
+  // a block of their own, the rest is merged with the tail
+  if (length > 0)
+  {
+    __m128i right = _mm_loadu_si128((const __m128i*) (Crc32ClmulShift + 16 + length));
+    __m128i head  = _mm_shuffle_epi8(remainder, _mm_loadu_si128((const __m128i*) (Crc32ClmulShift + length)));
+    __m128i tail  = _mm_blendv_epi8(_mm_shuffle_epi8(remainder, right),
+                                    _mm_loadu_si128((const __m128i*) (current + length - 16)), right);
+    remainder = crc32_clmul_fold(head, tail, fold128);
+  }
+  return ~crc32_clmul_reduce(remainder, constants);
+}
+
+/// compute CRC32 (PCLMUL folding and Barrett reduction, no tables)
+uint32_t crc32_clmul(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32_clmul, data, length);
+  return crc_clmul(data, length, previousCrc32, Crc32Clmul);
+}
+
+/// compute CRC32C (PCLMUL folding and Barrett reduction, no tables)
+uint32_t crc32c_clmul(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+  CRC32_STATS_RECORD(crc32c_clmul, data, length);
+  return crc_clmul(data, length, previousCrc32, Crc32cClmul);
+}
+#endif
+
+
+// //////////////////////////////////////////////////////////
+// public API: CRC32 and CRC32C with the kernel chosen at compile time
+
+/// upper bound for the lookup tables touched by crc32_fast/crc32c_fast, in bytes:
+/// 16384 = slicing-by-16, 4096 = slicing-by-4, 1024 = one table (+ Chorba for large buffers), 64 = half-byte
+#ifndef CRC32_TABLE_FOOTPRINT
+#define CRC32_TABLE_FOOTPRINT 16384
+#endif
+
+/// compute CRC32 (zlib polynomial)
+uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+#ifdef CRC32_PCLMUL
+  // short messages would mostly wait for cold table lines
+  if (length <= 256)
+    return crc32_clmul(data, length, previousCrc32);
+#endif
+#if   CRC32_TABLE_FOOTPRINT >= 16384 && CRC32_TABLE_LAYOUT == 1
+  return crc32_2x16bytes_interleaved(data, length, previousCrc32);
+#elif CRC32_TABLE_FOOTPRINT >= 16384 && CRC32_TABLE_LAYOUT == 2
+  return crc32_2x16bytes_huge(data, length, previousCrc32);
+#elif CRC32_TABLE_FOOTPRINT >= 16384
+  return crc32_2x16bytes(data, length, previousCrc32);
+#elif CRC32_TABLE_FOOTPRINT >= 4096
+  return crc32_4x4bytes (data, length, previousCrc32);
+#elif CRC32_TABLE_FOOTPRINT >= 1024
+  return crc32_chorba   (data, length, previousCrc32); // crc32_1byte for short messages
+#elif defined(__SSSE3__)
+  return crc32_halfbyte_simd(data, length, previousCrc32);
+#else
+  return crc32_halfbyte (data, length, previousCrc32);
+#endif
+}
+
+/// compute CRC32C (Castagnoli polynomial), same conventions as crc32_fast
+uint32_t crc32c_fast(const void* data, size_t length, uint32_t previousCrc32 = 0)
+{
+#if   defined(CRC32_SSE42)
+  return crc32c_sse42(data, length, previousCrc32); // no tables at all
+#elif defined(CRC32_PCLMUL)
+  return crc32c_clmul(data, length, previousCrc32); // no tables either
+#elif CRC32_TABLE_FOOTPRINT >= 8192
+  return crc32c_16bytes(data, length, previousCrc32);
+#elif CRC32_TABLE_FOOTPRINT >= 4096
+  return ~crc32cSlicingBy4x4(data, length, ~previousCrc32);
+#elif CRC32_TABLE_FOOTPRINT >= 1024
+  uint32_t crc = ~previousCrc32;
+  const uint8_t* current = (const uint8_t*) data;
+  while (length-- > 0)
+    crc = crc_tableil8_o32[(crc ^ *current++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+#else
+  return crc32c_halfbyte(data, length, previousCrc32);
+#endif
+}
+
+// //////////////////////////////////////////////////////////
+// CRC32 of many short independent messages (network frames), one CRC per message
+// With PCLMUL each message is folded 16 bytes at a time (see crc32_clmul); a fold has a latency
+// of about 8 cycles, so four messages are in flight: whenever one lane is done, the next message takes its
+// place and lanes of different lengths don't wait for each other. Table lookups are limited by load ports
+// instead of latency, and out-of-order execution already overlaps consecutive calls, so without PCLMUL
+// each message simply gets its own call.
+
+/// one slicing-by-8 step, same as crc32_8bytes
+static inline uint32_t crc32_messages_step8(uint32_t crc, const uint8_t* current)
+{
+#if __BYTE_ORDER == __BIG_ENDIAN
+  uint32_t one = *(const uint32_t*) current ^ swap(crc);
+  uint32_t two = *(const uint32_t*) (current + 4);
+  return Crc32Lookup[0][ two      & 0xFF] ^ Crc32Lookup[1][(two>> 8) & 0xFF] ^
+         Crc32Lookup[2][(two>>16) & 0xFF] ^ Crc32Lookup[3][(two>>24) & 0xFF] ^
+         Crc32Lookup[4][ one      & 0xFF] ^ Crc32Lookup[5][(one>> 8) & 0xFF] ^
+         Crc32Lookup[6][(one>>16) & 0xFF] ^ Crc32Lookup[7][(one>>24) & 0xFF];
+#else
+  uint32_t one = *(const uint32_t*) current ^ crc;
+  uint32_t two = *(const uint32_t*) (current + 4);
+  return Crc32Lookup[0][(two>>24) & 0xFF] ^ Crc32Lookup[1][(two>>16) & 0xFF] ^
+         Crc32Lookup[2][(two>> 8) & 0xFF] ^ Crc32Lookup[3][ two      & 0xFF] ^
+         Crc32Lookup[4][(one>>24) & 0xFF] ^ Crc32Lookup[5][(one>>16) & 0xFF] ^
+         Crc32Lookup[6][(one>> 8) & 0xFF] ^ Crc32Lookup[7][ one      & 0xFF];
+#endif
+}
+
+/// continue a CRC register (not inverted) over a few bytes
+static inline uint32_t crc32_messages_tail(uint32_t crc, const uint8_t* current, size_t length)
+{
+  for (; length >= 8; length -= 8, current += 8)
+    crc = crc32_messages_step8(crc, current);
+  while (length-- > 0)
+    crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *current++];
+  return crc;
+}
+
+#ifdef CRC32_PCLMUL
+/// a message in flight
+struct Crc32MessageLane
+{
+  const uint8_t* current;   // not folded yet
+  size_t         left;
+  size_t         message;
+  __m128i        remainder;
+};
+
+/// load the next message of at least 16 bytes into a lane (shorter ones are done right away),
+/// false if there is none
+static inline bool crc32_messages_refill(Crc32MessageLane& lane, const void* const* messages, const size_t* lengths,
+                                         size_t numMessages, uint32_t* crcs, size_t& next)
+{
+  for (; next < numMessages; next++)
+  {
+    const uint8_t* data = (const uint8_t*) messages[next];
+    if (lengths[next] < 16)
+    {
+      crcs[next] = ~crc32_messages_tail(0xFFFFFFFF, data, lengths[next]);
+      continue;
+    }
+    lane.current   = data + 16;
+    lane.left      = lengths[next] - 16;
+    lane.message   = next++;
+    lane.remainder = _mm_xor_si128(_mm_loadu_si128((const __m128i*) data), _mm_cvtsi32_si128(0xFFFFFFFF));
+    return true;
+  }
+  return false;
+}
+
+/// rest of a lane on its own
+static inline uint32_t crc32_messages_finish(Crc32MessageLane& lane, __m128i fold128)
+{
+  for (; lane.left >= 16; lane.left -= 16, lane.current += 16)
+    lane.remainder = crc32_clmul_fold(lane.remainder, _mm_loadu_si128((const __m128i*) lane.current), fold128);
+  return ~crc32_messages_tail(crc32_clmul_reduce(lane.remainder, Crc32Clmul), lane.current, lane.left);
+}
+#endif
+
+/// CRC32 of numMessages independent messages: crcs[i] = crc32_8bytes(messages[i], lengths[i])
+void crc32_messages(const void* const* messages, const size_t* lengths, size_t numMessages, uint32_t* crcs)
+{
+#ifdef CRC32_PCLMUL
+#ifdef CRC32_STATS
+  for (size_t i = 0; i < numMessages; i++)
+    CRC32_STATS_RECORD(crc32_messages, messages[i], lengths[i]);
+#endif
+  const int Lanes = 4;
+  const __m128i fold128 = _mm_load_si128((const __m128i*) Crc32Clmul.fold128);
+  Crc32MessageLane lanes[Lanes];
+  size_t next = 0;
+  int numLanes = 0;
+  while (numLanes < Lanes && crc32_messages_refill(lanes[numLanes], messages, lengths, numMessages, crcs, next))
+    numLanes++;
+
+  while (numLanes == Lanes)
+  {
+    // all lanes busy until the shortest one runs out of 16-byte blocks
+    size_t steps = lanes[0].left;
+    for (int lane = 1; lane < Lanes; lane++)
+      if (steps > lanes[lane].left)
+        steps = lanes[lane].left;
+    steps /= 16;
+    __m128i a = lanes[0].remainder, b = lanes[1].remainder, c = lanes[2].remainder, d = lanes[3].remainder;
+    const uint8_t *currentA = lanes[0].current, *currentB = lanes[1].current,
+                  *currentC = lanes[2].current, *currentD = lanes[3].current;
+    for (size_t step = 0; step < steps; step++)
+    {
+      a = crc32_clmul_fold(a, _mm_loadu_si128((const __m128i*) currentA), fold128);
+      b = crc32_clmul_fold(b, _mm_loadu_si128((const __m128i*) currentB), fold128);
+      c = crc32_clmul_fold(c, _mm_loadu_si128((const __m128i*) currentC), fold128);
+      d = crc32_clmul_fold(d, _mm_loadu_si128((const __m128i*) currentD), fold128);
+      currentA += 16, currentB += 16, currentC += 16, currentD += 16;
+    }
+    lanes[0].remainder = a, lanes[1].remainder = b, lanes[2].remainder = c, lanes[3].remainder = d;
+    lanes[0].current = currentA, lanes[1].current = currentB, lanes[2].current = currentC, lanes[3].current = currentD;
+
+    for (int lane = 0; lane < Lanes; lane++)
+      lanes[lane].left -= steps * 16;
+
+    // finish lanes with less than 16 bytes left and refill them; without more messages, the last lane moves
+    // into the gap and the remaining ones are finished one by one
+    for (int lane = 0; lane < numLanes; )
+    {
+      if (lanes[lane].left >= 16)
+      {
+        lane++;
+        continue;
+      }
+      crcs[lanes[lane].message] = crc32_messages_finish(lanes[lane], fold128);
+      if (!crc32_messages_refill(lanes[lane], messages, lengths, numMessages, crcs, next))
+        lanes[lane] = lanes[--numLanes];
+    }
+  }
+  for (int lane = 0; lane < numLanes; lane++)
+    crcs[lanes[lane].message] = crc32_messages_finish(lanes[lane], fold128);
+#else
+  // each call is recorded under the kernel crc32_fast picks
+  for (size_t i = 0; i < numMessages; i++)
+    crcs[i] = crc32_fast(messages[i], lengths[i]);
+#endif
+}
+
+// //////////////////////////////////////////////////////////
+// compile-time CRC32/CRC32C of string literals and constant data (C++14 and later):
+//   switch (crc32c(name, length)) { case crc32c("put"): ... }
+// same results as crc32_fast/crc32c_fast, at compile time a 256-entry table is built by the compiler itself;
+// at runtime (C++20) they use the table-free SSE4.2/PCLMUL kernels if compiled in, so they never need init()
+
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#include <array>
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#include <type_traits>
+#endif
+
+/// what crc32_1byte uses, built at compile time
+struct Crc32ConstexprTable
+{
+  uint32_t entry[256];
+};
+
+constexpr Crc32ConstexprTable crc32_constexpr_table(uint32_t polynomial)
+{
+  Crc32ConstexprTable table = {};
+  for (uint32_t i = 0; i <= 0xFF; i++)
+  {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ ((crc & 1) * polynomial);
+    table.entry[i] = crc;
+  }
+  return table;
+}
+
+constexpr Crc32ConstexprTable Crc32ConstexprLookup  = crc32_constexpr_table(Polynomial);
+constexpr Crc32ConstexprTable Crc32cConstexprLookup = crc32_constexpr_table(PolynomialCastagnoli);
+
+/// one byte at a time over anything indexable (const char*, std::array)
+template <typename Bytes>
+constexpr uint32_t crc32_constexpr(const Bytes& bytes, size_t length, uint32_t previousCrc32, const Crc32ConstexprTable& table)
+{
+  uint32_t crc = ~previousCrc32;
+  for (size_t i = 0; i < length; i++)
+    crc = (crc >> 8) ^ table.entry[(crc & 0xFF) ^ uint8_t(bytes[i])];
+  return ~crc;
+}
+
+/// length of a zero-terminated string
+constexpr size_t crc32_constexpr_strlen(const char* text)
+{
+  size_t length = 0;
+  while (text[length])
+    length++;
+  return length;
+}
+
+/// CRC32 (zlib polynomial) of a buffer, usable in constant expressions
+constexpr uint32_t crc32(const char* data, size_t length, uint32_t previousCrc32 = 0)
+{
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#ifdef CRC32_PCLMUL
+  if (!std::is_constant_evaluated())
+    return crc32_clmul(data, length, previousCrc32);
+#endif
+#endif
+  return crc32_constexpr(data, length, previousCrc32, Crc32ConstexprLookup);
+}
+
+/// CRC32 of a zero-terminated string (without the terminator), e.g. crc32("put")
+constexpr uint32_t crc32(const char* text)
+{
+  return crc32(text, crc32_constexpr_strlen(text));
+}
+
+/// CRC32 of constant binary data
+template <size_t N>
+constexpr uint32_t crc32(const std::array<uint8_t, N>& data, uint32_t previousCrc32 = 0)
+{
+  return crc32_constexpr(data, N, previousCrc32, Crc32ConstexprLookup);
+}
+
+/// CRC32C (Castagnoli polynomial) of a buffer, usable in constant expressions
+constexpr uint32_t crc32c(const char* data, size_t length, uint32_t previousCrc32 = 0)
+{
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#if defined(CRC32_SSE42)
+  if (!std::is_constant_evaluated())
+    return crc32c_sse42(data, length, previousCrc32);
+#elif defined(CRC32_PCLMUL)
+  if (!std::is_constant_evaluated())
+    return crc32c_clmul(data, length, previousCrc32);
+#endif
+#endif
+  return crc32_constexpr(data, length, previousCrc32, Crc32cConstexprLookup);
+}
+
+/// CRC32C of a zero-terminated string (without the terminator), e.g. crc32c("put")
+constexpr uint32_t crc32c(const char* text)
+{
+  return crc32c(text, crc32_constexpr_strlen(text));
+}
+
+/// CRC32C of constant binary data
+template <size_t N>
+constexpr uint32_t crc32c(const std::array<uint8_t, N>& data, uint32_t previousCrc32 = 0)
+{
+  return crc32_constexpr(data, N, previousCrc32, Crc32cConstexprLookup);
+}
+
+// check values of both polynomials, evaluated by the compiler
+static_assert(crc32 ("123456789") == 0xCBF43926, "CRC32 check value");
+static_assert(crc32c("123456789") == 0xE3069283, "CRC32C check value");
+static_assert(crc32c(std::array<uint8_t, 4>{{ 'p', 'u', 't', 0 }}) == crc32c("put\0", 4), "std::array and literal differ");
+#endif
+
+
+// //////////////////////////////////////////////////////////
+// resumable CRC state: running CRC plus byte count of a growing stream (append-only logs),
+// serialized to a fixed 32-byte record that can be stored in a sidecar file or as a footer
+// and resumed later, so that only bytes appended since then have to be hashed
+
+/// polynomial of a Crc32State
+enum Crc32StatePolynomial { Crc32StateCrc32 = 1, Crc32StateCrc32C = 2 };
+
+/// running CRC of the first length bytes of a stream
+struct Crc32State
+{
+  uint64_t length;
+  uint32_t crc;         // same as crc32_fast/crc32c_fast of these bytes
+  uint32_t polynomial;  // Crc32StatePolynomial
+};
+
+/// serialized size and format version
+const size_t   Crc32StateSize    = 32;
+const uint16_t Crc32StateVersion = 1;
+
+/// empty stream
+void crc32_state_init(Crc32State& state, bool castagnoli = false)
+{
+  state.length     = 0;
+  state.crc        = 0;
+  state.polynomial = castagnoli ? Crc32StateCrc32C : Crc32StateCrc32;
+}
+
+/// hash the next bytes of the stream
+void crc32_state_update(Crc32State& state, const void* data, size_t length)
+{
+  state.crc = (state.polynomial == Crc32StateCrc32C ? crc32c_fast : crc32_fast)(data, length, state.crc);
+  state.length += length;
+}
+
+/// little-endian fields of a serialized state
+static void crc32_state_put(uint8_t* out, uint64_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+    out[i] = uint8_t(value >> (8*i));
+}
+static uint64_t crc32_state_get(const uint8_t* in, int bytes)
+{
+  uint64_t value = 0;
+  for (int i = bytes - 1; i >= 0; i--)
+    value = (value << 8) | in[i];
+  return value;
+}
+
+/// serialize (little endian on every host):
+/// bytes 0-3 "CRCS", 4-5 version, 6-7 polynomial, 8-15 length, 16-19 crc, 20-27 zero, 28-31 CRC32C of bytes 0-27
+void crc32_state_encode(const Crc32State& state, uint8_t record[Crc32StateSize])
+{
+  record[0] = 'C'; record[1] = 'R'; record[2] = 'C'; record[3] = 'S';
+  crc32_state_put(record +  4, Crc32StateVersion, 2);
+  crc32_state_put(record +  6, state.polynomial,  2);
+  crc32_state_put(record +  8, state.length,      8);
+  crc32_state_put(record + 16, state.crc,         4);
+  crc32_state_put(record + 20, 0,                 8);
+  crc32_state_put(record + 28, crc32c_fast(record, 28), 4);
+}
+
+/// deserialize, false if the record is torn, damaged or of an unknown version
+bool crc32_state_decode(const uint8_t record[Crc32StateSize], Crc32State& state)
+{
+  uint64_t polynomial = crc32_state_get(record + 6, 2);
+  if (record[0] != 'C' || record[1] != 'R' || record[2] != 'C' || record[3] != 'S' ||
+      crc32_state_get(record + 28, 4) != crc32c_fast(record, 28) ||
+      crc32_state_get(record +  4, 2) != Crc32StateVersion ||
+      (polynomial != Crc32StateCrc32 && polynomial != Crc32StateCrc32C))
+    return false;
+  state.polynomial = uint32_t(polynomial);
+  state.length     = crc32_state_get(record +  8, 8);
+  state.crc        = uint32_t(crc32_state_get(record + 16, 4));
+  return true;
+}
+
+
+// //////////////////////////////////////////////////////////
+// multithreaded CRC of large buffers: the buffer is cut into pieces whose CRCs are glued with
+// crc32_combine; on Linux each piece is handled by a thread pinned to the NUMA node owning its memory
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+/// common signature of crc32_combine and crc32c_combine
+typedef uint32_t (*Crc32CombineFunction)(uint32_t crcA, uint32_t crcB, uint64_t lengthB);
+
+/// bytes handed to a thread at once
+const size_t Crc32ParallelPiece = 4*1024*1024;
+
+#ifdef __linux__
+/// read a sysfs list like "0-15,32-47", false if the file doesn't exist
+static bool crc32_read_list(const char* path, std::vector<int>& ids)
+{
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return false;
+  int from, to;
+  while (fscanf(file, "%d", &from) == 1)
+  {
+    to = from;
+    if (fscanf(file, "-%d", &to) < 0)
+      to = from;
+    for (int id = from; id <= to; id++)
+      ids.push_back(id);
+    if (fgetc(file) != ',')
+      break;
+  }
+  fclose(file);
+  return true;
+}
+
+/// owner of a piece: the node holding most of 16 sampled pages, -1 if none holds more than half
+/// (page-interleaved memory, pages not faulted in yet, no NUMA support)
+static int crc32_piece_node(const char* start, size_t length)
+{
+  const int Samples = 16;
+  void* pages[Samples];
+  int   nodes[Samples];
+  for (int i = 0; i < Samples; i++)
+    pages[i] = (void*) (uintptr_t(start + length / Samples * i) & ~uintptr_t(4095));
+  // move_pages without target nodes only reports where the pages are
+  if (syscall(SYS_move_pages, 0, (unsigned long) Samples, pages, NULL, nodes, 0) != 0)
+    for (int i = 0; i < Samples; i++)
+      if (syscall(SYS_get_mempolicy, &nodes[i], NULL, 0UL, pages[i], (unsigned long) (MPOL_F_NODE | MPOL_F_ADDR)) != 0)
+        nodes[i] = -1;
+
+  int best = -1, bestVotes = 0;
+  for (int i = 0; i < Samples; i++)
+  {
+    int votes = 0;
+    for (int j = 0; j < Samples; j++)
+      votes += (nodes[j] == nodes[i]);
+    if (votes > bestVotes)
+      best = nodes[i], bestVotes = votes;
+  }
+  return (bestVotes > Samples / 2 && best >= 0) ? best : -1;
+}
+
+/// pin the calling thread to the CPUs of a NUMA node, false if that failed
+static bool crc32_pin_to_node(int node)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  std::vector<int> ids;
+  if (!crc32_read_list(path, ids))
+    return false;
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (size_t i = 0; i < ids.size(); i++)
+    if (ids[i] < CPU_SETSIZE)
+      CPU_SET(ids[i], &cpus);
+  return CPU_COUNT(&cpus) > 0 && sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+#endif
+
+/// compute CRC32 (or CRC32C, with crc32c_fast and crc32c_combine) of a large buffer with several threads,
+/// numThreads = 0 uses all cores; if numaAware is false the pieces go to unpinned threads in order
+uint32_t crc32_parallel(const void* data, size_t length, uint32_t previousCrc32 = 0, unsigned numThreads = 0,
+                        Crc32Function kernel = crc32_fast, Crc32CombineFunction combine = crc32_combine,
+                        bool numaAware = true)
+{
+  size_t numPieces = (length + Crc32ParallelPiece - 1) / Crc32ParallelPiece;
+  if (numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+  if (numThreads > numPieces)
+    numThreads = unsigned(numPieces);
+  if (numThreads <= 1)
+    return kernel(data, length, previousCrc32);
+
+  const char* bytes = (const char*) data;
+  // queue q holds the pieces owned by node q-1, queue 0 all others
+  std::vector<std::vector<size_t> > queues(1);
+  for (size_t i = 0; i < numPieces; i++)
+  {
+    int node = -1;
+#ifdef __linux__
+    if (numaAware)
+    {
+      size_t start = i * Crc32ParallelPiece;
+      node = crc32_piece_node(bytes + start, length - start < Crc32ParallelPiece ? length - start : Crc32ParallelPiece);
+    }
+#endif
+    if (size_t(node + 1) >= queues.size())
+      queues.resize(node + 2);
+    queues[node + 1].push_back(i);
+  }
+  std::vector<std::atomic<size_t> > next(queues.size());
+  for (size_t q = 0; q < queues.size(); q++)
+    next[q] = 0;
+
+  // threads go to the nodes with the most pieces per thread
+  std::vector<size_t> threadQueue(numThreads, 0), assigned(queues.size(), 0);
+  for (unsigned t = 0; t < numThreads; t++)
+  {
+    size_t best = 0;
+    for (size_t q = 1; q < queues.size(); q++)
+      if (queues[q].size() * (assigned[best] + 1) > queues[best].size() * (assigned[q] + 1))
+        best = q;
+    threadQueue[t] = best;
+    assigned[best]++;
+  }
+
+  std::vector<uint32_t> crcs(numPieces);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < numThreads; t++)
+    threads.push_back(std::thread([&, t]
+    {
+      size_t home = threadQueue[t];
+#ifdef __linux__
+      if (home > 0)
+        crc32_pin_to_node(int(home) - 1);
+#endif
+      // own node first, then the unowned pieces, then help the other nodes
+      for (size_t k = 0; k < queues.size(); k++)
+      {
+        size_t q = (k == 0) ? home : (k <= home ? k - 1 : k);
+        for (size_t index; (index = next[q]++) < queues[q].size(); )
+        {
+          size_t piece = queues[q][index];
+          size_t start = piece * Crc32ParallelPiece;
+          crcs[piece] = kernel(bytes + start, length - start < Crc32ParallelPiece ? length - start : Crc32ParallelPiece, 0);
+        }
+      }
+    }));
+  for (unsigned t = 0; t < numThreads; t++)
+    threads[t].join();
+
+  uint32_t crc = previousCrc32;
+  for (size_t i = 0; i < numPieces; i++)
+  {
+    size_t start = i * Crc32ParallelPiece;
+    crc = combine(crc, crcs[i], length - start < Crc32ParallelPiece ? length - start : Crc32ParallelPiece);
+  }
+  return crc;
+}
+
+
+// //////////////////////////////////////////////////////////
+// in-process checksum service shared by all subsystems of a process:
+// interactive jobs (RPC payloads) go to one queue that workers drain in batches and always look at first,
+// bulk jobs (scrubs) are cut into pieces that are dealt to per-worker deques, stolen by idle workers
+// and glued with crc32_combine when the last piece is done
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+
+/// jobs are split into pieces of that size, which also bounds how long a bulk piece keeps a worker from interactive jobs
+const size_t Crc32ServicePiece = 256*1024;
+/// a worker takes up to that many interactive pieces (and at least one, but at most that many bytes) at once
+const size_t Crc32ServiceBatchJobs  = 32;
+const size_t Crc32ServiceBatchBytes = 256*1024;
+
+class Crc32Service
+{
+public:
+  enum Priority { Interactive, Bulk };
+  /// invoked by a worker thread as soon as the job is done, shouldn't block
+  typedef std::function<void(uint32_t crc)> Callback;
+
+  /// numThreads = 0 uses all cores; with priorities one worker (if there are at least two) never runs bulk pieces,
+  /// without them all jobs share the FIFO deques like plain pool tasks (for comparison)
+  explicit Crc32Service(unsigned numThreads = 0, Crc32Function kernel = crc32_fast,
+                        Crc32CombineFunction combine = crc32_combine, bool priorities = true)
+  : kernel(kernel), combine(combine), priorities(priorities),
+    queues(numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency())),
+    nextQueue(0), pendingInteractive(0), pendingBulk(0), stopping(false)
+  {
+    for (unsigned t = 0; t < queues.size(); t++)
+      workers.push_back(std::thread(&Crc32Service::work, this, t));
+  }
+
+  /// finishes all submitted jobs
+  ~Crc32Service()
+  {
+    {
+      std::lock_guard<std::mutex> guard(wakeLock);
+      stopping = true;
+    }
+    wakeup.notify_all();
+    for (size_t t = 0; t < workers.size(); t++)
+      workers[t].join();
+  }
+
+  /// CRC of a buffer that must stay valid until the future is ready
+  std::future<uint32_t> submit(const void* data, size_t length, Priority priority = Interactive, uint32_t previousCrc32 = 0)
+  {
+    std::shared_ptr<std::promise<uint32_t> > promise = std::make_shared<std::promise<uint32_t> >();
+    std::future<uint32_t> result = promise->get_future();
+    submit(data, length, [promise](uint32_t crc) { promise->set_value(crc); }, priority, previousCrc32);
+    return result;
+  }
+
+  /// CRC of a buffer that must stay valid until done is called
+  void submit(const void* data, size_t length, Callback done, Priority priority = Interactive, uint32_t previousCrc32 = 0)
+  {
+    submit(data, length, std::move(done), priority, previousCrc32, kernel, combine);
+  }
+
+  /// same with another kernel/polynomial than the service's default (e.g. crc32c_fast and crc32c_combine)
+  void submit(const void* data, size_t length, Callback done, Priority priority, uint32_t previousCrc32,
+              Crc32Function jobKernel, Crc32CombineFunction jobCombine)
+  {
+    size_t numPieces = length <= Crc32ServicePiece ? 1 : (length + Crc32ServicePiece - 1) / Crc32ServicePiece;
+    Job* job = new Job;
+    job->data          = (const char*) data;
+    job->length        = length;
+    job->previousCrc32 = previousCrc32;
+    job->kernel        = jobKernel;
+    job->combine       = jobCombine;
+    job->done          = std::move(done);
+    job->crcs.resize(numPieces);
+    job->remaining     = numPieces;
+
+    if (priorities && priority == Interactive)
+    {
+      announce(pendingInteractive, numPieces);
+      {
+        std::lock_guard<std::mutex> guard(interactive.lock);
+        for (size_t i = 0; i < numPieces; i++)
+          interactive.tasks.push_back(Task(job, i));
+      }
+      wake(pendingInteractive, numPieces);
+    }
+    else
+    {
+      // deal the pieces round-robin, idle workers steal the rest
+      announce(pendingBulk, numPieces);
+      unsigned first = nextQueue++;
+      for (size_t i = 0; i < numPieces; i++)
+      {
+        Queue& queue = queues[(first + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(Task(job, i));
+      }
+      wake(pendingBulk, numPieces);
+    }
+  }
+
+  unsigned numThreads() const { return unsigned(workers.size()); }
+
+private:
+  /// one submitted buffer
+  struct Job
+  {
+    const char* data;
+    size_t      length;
+    uint32_t    previousCrc32;
+    Crc32Function        kernel;
+    Crc32CombineFunction combine;
+    Callback    done;
+    std::vector<uint32_t> crcs;      // one per piece
+    std::atomic<size_t>   remaining; // pieces not finished yet
+  };
+  /// one piece of a job
+  struct Task
+  {
+    Job*   job;
+    size_t piece;
+    Task(Job* job, size_t piece) : job(job), piece(piece) {}
+    size_t length() const
+    {
+      size_t start = piece * Crc32ServicePiece;
+      return job->length - start < Crc32ServicePiece ? job->length - start : Crc32ServicePiece;
+    }
+  };
+  struct Queue
+  {
+    std::mutex        lock;
+    std::deque<Task>  tasks;
+  };
+
+  /// count new tasks before they are queued: a worker may pop them before wake() runs,
+  /// and the count must not drop below zero (idle workers would spin on it)
+  void announce(std::atomic<size_t>& pending, size_t numTasks)
+  {
+    std::lock_guard<std::mutex> guard(wakeLock);
+    pending += numTasks;
+  }
+
+  /// wake up workers after queueing announced tasks
+  void wake(std::atomic<size_t>& pending, size_t numTasks)
+  {
+    // the worker reserved for interactive jobs would swallow a single wakeup for bulk work
+    if (numTasks == 1 && &pending == &pendingInteractive)
+      wakeup.notify_one();
+    else
+      wakeup.notify_all();
+  }
+
+  /// a batch of interactive pieces
+  bool popInteractive(std::vector<Task>& batch)
+  {
+    std::lock_guard<std::mutex> guard(interactive.lock);
+    size_t bytes = 0;
+    while (!interactive.tasks.empty() && batch.size() < Crc32ServiceBatchJobs &&
+           (batch.empty() || bytes + interactive.tasks.front().length() <= Crc32ServiceBatchBytes))
+    {
+      bytes += interactive.tasks.front().length();
+      batch.push_back(interactive.tasks.front());
+      interactive.tasks.pop_front();
+    }
+    pendingInteractive -= batch.size();
+    return !batch.empty();
+  }
+
+  /// one bulk piece: own deque first (oldest), then steal from the others (newest)
+  bool popBulk(unsigned self, std::vector<Task>& batch)
+  {
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+      Queue& queue = queues[(self + i) % queues.size()];
+      std::lock_guard<std::mutex> guard(queue.lock);
+      if (queue.tasks.empty())
+        continue;
+      if (i == 0)
+        batch.push_back(queue.tasks.front()), queue.tasks.pop_front();
+      else
+        batch.push_back(queue.tasks.back()),  queue.tasks.pop_back();
+      pendingBulk--;
+      return true;
+    }
+    return false;
+  }
+
+  /// hash one piece, the last piece of a job combines all CRCs and completes it
+  void run(const Task& task)
+  {
+    Job* job = task.job;
+    size_t start = task.piece * Crc32ServicePiece;
+    job->crcs[task.piece] = job->kernel(job->data + start, task.length(), task.piece == 0 ? job->previousCrc32 : 0);
+    if (job->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+
+    uint32_t crc = job->crcs[0];
+    for (size_t i = 1; i < job->crcs.size(); i++)
+      crc = job->combine(crc, job->crcs[i], Task(job, i).length());
+    job->done(crc);
+    delete job;
+  }
+
+  void work(unsigned self)
+  {
+    const bool runsBulk = !priorities || queues.size() < 2 || self != 0;
+    std::vector<Task> batch;
+    for (;;)
+    {
+      // interactive work always first, bulk pieces are short enough to check again soon
+      batch.clear();
+      if (popInteractive(batch) || (runsBulk && popBulk(self, batch)))
+      {
+        for (size_t i = 0; i < batch.size(); i++)
+          run(batch[i]);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> guard(wakeLock);
+      if (stopping && pendingInteractive == 0 && (!runsBulk || pendingBulk == 0))
+        return;
+      wakeup.wait(guard, [&] { return pendingInteractive > 0 || (runsBulk && pendingBulk > 0) || stopping; });
+    }
+  }
+
+  Crc32Function         kernel;
+  Crc32CombineFunction  combine;
+  bool                  priorities;
+  Queue                 interactive;
+  std::vector<Queue>    queues;      // bulk pieces, one deque per worker
+  std::atomic<unsigned> nextQueue;
+  std::atomic<size_t>   pendingInteractive, pendingBulk;
+  std::mutex              wakeLock;
+  std::condition_variable wakeup;
+  bool                    stopping;
+  std::vector<std::thread> workers;
+};
+
+
+// //////////////////////////////////////////////////////////
+// constants
+
+void init()
+{
+  // same algorithm as crc32_bitwise
+  for (int i = 0; i <= 0xFF; i++)
+  {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ ((crc & 1) * Polynomial);
+    Crc32Lookup[0][i] = crc;
+  }
+  // ... and the following slicing-by-8 algorithm (from Intel):
+  // http://www.intel.com/technology/comms/perfnet/download/CRC_generators.pdf
+  // http://sourceforge.net/projects/slicing-by-8/
+  for (int i = 0; i <= 0xFF; i++)
+  {
+    for (int j=0; j<15; j++)
+      Crc32Lookup[j+1][i] = (Crc32Lookup[j][i] >> 8) ^ Crc32Lookup[0][Crc32Lookup[j][i] & 0xFF];
+  }
+
+  // x^1, x^2, x^4, ... for crc32_combine
+  Crc32Powers[0] = Crc32cPowers[0] = 1u << 30;
+  for (int n = 1; n < 32; n++)
+  {
+    Crc32Powers [n] = multmodp(Crc32Powers [n-1], Crc32Powers [n-1], Polynomial);
+    Crc32cPowers[n] = multmodp(Crc32cPowers[n-1], Crc32cPowers[n-1], PolynomialCastagnoli);
+  }
+
+#ifdef CRC32_TABLE_LAYOUTS
+  initTableLayouts();
+#endif
+}
+
+// //////////////////////////////////////////////////////////
+// test code
+// (tools that #include this file define CRC32_NO_BENCHMARK to drop it)
+#ifndef CRC32_NO_BENCHMARK
+
+
+/// one gigabyte
+const size_t NumBytes = 1024*1024*1024;
+/// 4k chunks during last test
+const size_t DefaultChunkSize = 4*1024;
+
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#ifdef _MSC_VER
+#include <windows.h>
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// timing
+static double seconds()
+{
+#ifdef _MSC_VER
+  LARGE_INTEGER frequency, now;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter  (&now);
+  return now.QuadPart / double(frequency.QuadPart);
+#else
+  return clock() / double(CLOCKS_PER_SEC);
+#endif
+}
+
+
+/// CRC32C reference (bitwise algorithm), raw values like crc32cSlicingByXX (no pre/post inversion)
+static uint32_t crc32cBitwise(const void* data, size_t length, uint32_t crc)
+{
+  const uint8_t* current = (const uint8_t*) data;
+  while (length-- > 0)
+  {
+    crc ^= *current++;
+    for (int j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ (-int32_t(crc & 1) & PolynomialCastagnoli);
+  }
+  return crc;
+}
+
+/// all crc32cSlicingByXX against the bitwise reference: every length up to 100 bytes, every alignment
+static bool checkCrc32c()
+{
+  typedef uint32_t (*Crc32cFunction)(const void*, size_t, uint32_t);
+  static const Crc32cFunction Functions[] = { crc32cSlicingBy4, crc32cSlicingBy2x4, crc32cSlicingBy4x4,
+                                              crc32cSlicingBy8, crc32cSlicingBy16,  crc32cSlicingBy32 };
+  static const char* Names[] = { "+  4", "+2*4", "+4*4", "+  8", "+2*8", "+4*8" };
+
+  // "123456789" must give the well-known check value E3069283
+  if (~crc32cBitwise("123456789", 9, ~0u) != 0xE3069283)
+  {
+    printf("CRC32C reference is broken\n");
+    return false;
+  }
+
+  uint8_t buffer[128];
+  for (size_t i = 0; i < sizeof(buffer); i++)
+    buffer[i] = uint8_t(i * 37 + 11);
+
+  bool ok = true;
+  for (size_t f = 0; f < sizeof(Functions) / sizeof(Functions[0]); f++)
+    for (size_t offset = 0; offset < 8; offset++)
+      for (size_t length = 0; length + offset <= 100; length++)
+        if (Functions[f](buffer + offset, length, 0x12345678) != crc32cBitwise(buffer + offset, length, 0x12345678))
+        {
+          printf("%s bytes at once: wrong CRC32C for %u bytes at offset %u\n", Names[f], unsigned(length), unsigned(offset));
+          ok = false;
+          break;
+        }
+  return ok;
+}
+
+/// time stamp counter (reference cycles), 0 if not available
+static uint64_t ticks()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+/// kernels compared by the benchmark, in output order ("+" marks CRC32C)
+struct Kernel
+{
+  const char*   name;
+  Crc32Function function;
+  bool          slow;      // skipped by the 1 GB runs
+};
+
+static const Kernel Kernels[] =
+{
+  { "bitwise          ", crc32_bitwise,      true  },
+  { "half-byte        ", crc32_halfbyte,     true  },
+#ifdef __SSSE3__
+  { "half-byte simd   ", crc32_halfbyte_simd, false },
+#endif
+  { " 88 bytes at once", crc32_88bytes,      false },
+  { "  1 byte  at once", crc32_1byte,        false },
+  { "+  4 bytes at once", crc32cSlicingBy4,   false },
+  { "+2*4 bytes at once", crc32cSlicingBy2x4, false },
+  { "+4*4 bytes at once", crc32cSlicingBy4x4, false },
+  { "+  8 bytes at once", crc32cSlicingBy8,   false },
+  { "+2*8 bytes at once", crc32cSlicingBy16,  false },
+  { "+4*8 bytes at once", crc32cSlicingBy32,  false },
+  { "  4 bytes at once", crc32_4bytes,       false },
+  { "2*4 bytes at once", crc32_2x4bytes,     false },
+  { "4*4 bytes at once", crc32_4x4bytes,     false },
+  { "  8 bytes at once", crc32_8bytes,       false },
+  { " 16 bytes at once", crc32_16bytes,      false },
+  { "2*16 bytes at once", crc32_2x16bytes,    false },
+  { "chorba (1 KB table)", crc32_chorba,      false },
+  { "2*8 bytes at once", crc32_2x8bytes,     false },
+  { "4*8 bytes at once", crc32_4x8bytes,     false },
+#ifdef CRC32_SSE42
+  { "+sse4.2 crc32c   ", crc32c_sse42,       false },
+#endif
+#ifdef CRC32_PCLMUL
+  { "pclmul barrett   ", crc32_clmul,        false },
+  { "+pclmul barrett  ", crc32c_clmul,       false },
+#endif
+  { "+half-byte       ", crc32c_halfbyte,    true  },
+#ifdef CRC32_TABLE_LAYOUTS
+  { " 16 bytes interleaved", crc32_16bytes_interleaved,   false },
+  { "2*16 bytes interleaved", crc32_2x16bytes_interleaved, false },
+  { " 16 bytes huge page", crc32_16bytes_huge,   false },
+  { "2*16 bytes huge page", crc32_2x16bytes_huge, false },
+  { "  2 bytes 16-bit index", crc32_2bytes_16bit, false },
+  { "  8 bytes 16-bit index", crc32_8bytes_16bit, false },
+#endif
+};
+const int NumKernels = sizeof(Kernels) / sizeof(Kernels[0]);
+
+/// all CRC32 kernels (and crc32_fast) against crc32_bitwise: short messages at every length and alignment,
+/// and lengths on both sides of the thresholds where kernels switch algorithms (chorba: 8192 bytes)
+static bool checkCrc32()
+{
+  static const Kernel Extra[] =
+  {
+    { "crc32_fast       ", crc32_fast,                 false },
+    { "prefetch         ", crc32_16bytes_prefetch,     false },
+    { "prefetch nta     ", crc32_16bytes_prefetch_nta, false },
+  };
+  static const size_t Long[] = { 8191, 8192, 8193, 8199, 8192 + 2400, 9000, 20007, 65536 + 5 };
+  const size_t MaxLength = 65536 + 5 + 8;
+
+  uint8_t* buffer = new uint8_t[MaxLength];
+  for (size_t i = 0; i < MaxLength; i++)
+    buffer[i] = uint8_t(i * 37 + 11 + (i >> 8));
+
+  bool ok = true;
+  for (int k = 0; k < NumKernels + 3; k++)
+  {
+    const Kernel& kernel = k < NumKernels ? Kernels[k] : Extra[k - NumKernels];
+    if (kernel.name[0] == '+')
+      continue; // CRC32C, see checkCrc32c
+    for (size_t offset = 0; offset < 8 && ok; offset++)
+    {
+      for (size_t length = 0; length <= 300 && ok; length++)
+        if (kernel.function(buffer + offset, length, 0x12345678) != crc32_bitwise(buffer + offset, length, 0x12345678))
+        {
+          printf("%s: wrong CRC32 for %u bytes at offset %u\n", kernel.name, unsigned(length), unsigned(offset));
+          ok = false;
+        }
+      for (size_t i = 0; i < sizeof(Long) / sizeof(Long[0]) && ok; i++)
+        if (kernel.function(buffer + offset, Long[i], 0x12345678) != crc32_bitwise(buffer + offset, Long[i], 0x12345678))
+        {
+          printf("%s: wrong CRC32 for %u bytes at offset %u\n", kernel.name, unsigned(Long[i]), unsigned(offset));
+          ok = false;
+        }
+    }
+  }
+
+  delete[] buffer;
+  return ok;
+}
+
+
+/// default mode: each kernel over the whole buffer
+static void benchmarkThroughput(const char* data)
+{
+  double startTime, duration;
+  uint32_t crc;
+
+  for (int k = 0; k < NumKernels; k++)
+  {
+    if (Kernels[k].slow)
+      continue;
+    startTime = seconds();
+    crc = Kernels[k].function(data, NumBytes, 0);
+    duration  = seconds() - startTime;
+    printf("%s: CRC=%08X, %.3fs, %.3f MB/s\n",
+           Kernels[k].name, crc, duration, (NumBytes / (1024*1024)) / duration);
+  }
+
+  // eight bytes at once, process in 4k chunks
   startTime = seconds();
-  crc = crc32_4x8bytes(data, NumBytes);
+  crc = 0; // also default parameter of crc32_xx functions
+  size_t bytesProcessed = 0;
+  while (bytesProcessed < NumBytes)
+  {
+    size_t bytesLeft = NumBytes - bytesProcessed;
+    size_t chunkSize = (DefaultChunkSize < bytesLeft) ? DefaultChunkSize : bytesLeft;
+
+    crc = crc32_8bytes(data, chunkSize, crc);
+
+    bytesProcessed += chunkSize;
+  }
   duration  = seconds() - startTime;
-  printf("4*8 bytes at once: CRC=%08X, %.3fs, %.3f MB/s\n",
-         crc, duration, (NumBytes / (1024*1024)) / duration);
+  printf("chunked        : CRC=%08X, %.3fs, %.3f MB/s\n",
+    crc, duration, (NumBytes / (1024*1024)) / duration);
+}
+
+
+/// CRC32C of storage blocks, one CRC per block (CRC shown is CRC32 of the CRC array)
+static void benchmarkBlocks(const char* data)
+{
+  const size_t BlockSizes[] = { 512, 4096, 65536 };
+  uint32_t* blockCrcs = new uint32_t[NumBytes / BlockSizes[0]];
+  for (int size = 0; size < 3; size++)
+  {
+    size_t blockSize = BlockSizes[size];
+    size_t numBlocks = NumBytes / blockSize;
+    for (int method = 0; method < 3; method++)
+    {
+      static const char* const names[] = { "1 by 1", "tables", "sse4.2" };
+      double startTime = seconds();
+      if (method == 0)
+        for (size_t i = 0; i < numBlocks; i++)
+          blockCrcs[i] = crc32c_16bytes(data + i*blockSize, blockSize);
+      else if (method == 1)
+        crc32c_blocks_tables(data, blockSize, numBlocks, blockCrcs);
+      else
+        crc32c_blocks(data, blockSize, numBlocks, blockCrcs);
+      double duration  = seconds() - startTime;
+
+      uint32_t crc = crc32_16bytes(blockCrcs, numBlocks * sizeof(uint32_t));
+#ifndef CRC32_SSE42
+      if (method == 2)
+        break;
+#endif
+      printf("+%5u byte blocks, %s: CRC=%08X, %.3fs, %.3f M blocks/s\n",
+             unsigned(blockSize), names[method], crc, duration, numBlocks / duration / 1e6);
+    }
+  }
+  delete[] blockCrcs;
+}
+
+
+// //////////////////////////////////////////////////////////
+// latency of single calls with cold tables or under cache pressure
+
+#include <algorithm>
+#include <vector>
+
+/// lookup tables of all kernels, for eviction
+struct TableRegion
+{
+  const void* start;
+  size_t      size;
+};
+
+static const TableRegion Tables[] =
+{
+  { Crc32Lookup,      sizeof(Crc32Lookup)      },
+  { crc_tableil8_o32, sizeof(crc_tableil8_o32) },
+  { crc_tableil8_o40, sizeof(crc_tableil8_o40) },
+  { crc_tableil8_o48, sizeof(crc_tableil8_o48) },
+  { crc_tableil8_o56, sizeof(crc_tableil8_o56) },
+  { crc_tableil8_o64, sizeof(crc_tableil8_o64) },
+  { crc_tableil8_o72, sizeof(crc_tableil8_o72) },
+  { crc_tableil8_o80, sizeof(crc_tableil8_o80) },
+  { crc_tableil8_o88, sizeof(crc_tableil8_o88) },
+#ifdef CRC32_TABLE_LAYOUTS
+  { Crc32LookupInterleaved, sizeof(Crc32LookupInterleaved) },
+#endif
+#ifdef CRC32_PCLMUL
+  // not tables, but they'd be just as cold
+  { &Crc32Clmul,      sizeof(Crc32Clmul)       },
+  { &Crc32cClmul,     sizeof(Crc32cClmul)      },
+  { Crc32ClmulShift,  sizeof(Crc32ClmulShift)  },
+#endif
+};
+
+/// message sizes of the latency modes
+static const size_t LatencySizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+const int NumLatencySizes = sizeof(LatencySizes) / sizeof(LatencySizes[0]);
+
+/// TSC ticks per nanosecond
+static double ticksPerNanosecond()
+{
+  double   startTime  = seconds();
+  uint64_t startTicks = ticks();
+  while (seconds() - startTime < 0.05) {}
+  return (ticks() - startTicks) / ((seconds() - startTime) * 1e9);
+}
+
+/// touch every cache line of a buffer (reads and writes, like application data)
+static void pollute(char* buffer, size_t size)
+{
+  for (size_t i = 0; i < size; i += 64)
+    buffer[i]++;
+}
+
+/// what happens before each timed call
+struct LatencySetup
+{
+  bool   clflush;       // flush tables with clflush
+  char*  thrash;        // ... or walk through this buffer
+  size_t thrashSize;
+};
+
+static void prepareCall(const LatencySetup& setup, const char* data, size_t size)
+{
+#if defined(_MSC_VER) || defined(__SSE2__)
+  if (setup.clflush)
+  {
+    for (size_t t = 0; t < sizeof(Tables) / sizeof(Tables[0]); t++)
+      for (size_t i = 0; i < Tables[t].size; i += 64)
+        _mm_clflush((const char*) Tables[t].start + i);
+#ifdef CRC32_TABLE_LAYOUTS
+    // allocated by init()
+    for (size_t i = 0; Crc32HugeTables && i < Crc32HugeTablesSize; i += 64)
+      _mm_clflush((const char*) Crc32HugeTables + i);
+#endif
+    _mm_mfence();
+  }
+#endif
+  if (setup.thrash)
+  {
+    pollute(setup.thrash, setup.thrashSize);
+    // only the tables should be cold, bring the message back
+    volatile char sink = 0;
+    for (size_t i = 0; i < size; i += 64)
+      sink = sink + data[i]; // no compound assignment to a volatile (deprecated in C++20)
+    (void) sink;
+  }
+}
+
+/// median duration of one call in TSC ticks
+static double medianTicks(Crc32Function function, const char* data, size_t size, int repeats, const LatencySetup& setup)
+{
+  std::vector<uint64_t> samples(repeats);
+  volatile uint32_t sink = 0;
+  for (int r = 0; r < repeats; r++)
+  {
+    prepareCall(setup, data, size);
+#if defined(_MSC_VER) || defined(__SSE2__)
+    _mm_lfence();
+#endif
+    uint64_t start = ticks();
+    sink = function(data, size, sink);
+#if defined(_MSC_VER) || defined(__SSE2__)
+    _mm_lfence();
+#endif
+    samples[r] = ticks() - start;
+  }
+  std::nth_element(samples.begin(), samples.begin() + repeats/2, samples.end());
+  return double(samples[repeats/2]);
+}
+
+/// "cold" and "pressure" modes: ns per call for each kernel and size, disturbed vs undisturbed
+static int benchmarkLatency(const char* data, bool cold, int argc, char** argv)
+{
+  int    repeats   = 101;
+  size_t thrashKB  = cold ? 0 : 256;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+      repeats = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      thrashKB = strtoul(argv[++i], NULL, 0);
+    else
+    {
+      printf(cold ? "Usage: Crc32 cold [-r REPEATS] [-t THRASH_KB (evict with a buffer walk instead of clflush)]\n"
+                  : "Usage: Crc32 pressure [-r REPEATS] [-t CO-WORKLOAD_KB]\n");
+      return 1;
+    }
+  }
+  if (repeats < 1)
+    repeats = 1;
+  if (ticks() == 0)
+  {
+    printf("this mode needs a time stamp counter\n");
+    return 1;
+  }
+
+  LatencySetup quiet = { false, NULL, 0 };
+  LatencySetup disturbed = { false, NULL, thrashKB * 1024 };
+  std::vector<char> thrash(disturbed.thrashSize + 1);
+  if (thrashKB)
+    disturbed.thrash = &thrash[0];
+  else
+  {
+#if defined(_MSC_VER) || defined(__SSE2__)
+    disturbed.clflush = true;
+#else
+    printf("clflush not available, use -t\n");
+    return 1;
+#endif
+  }
+
+  double scale = 1 / ticksPerNanosecond();
+  if (cold)
+    printf("first-call latency, ns (median of %d): tables evicted by %s / warm\n",
+           repeats, thrashKB ? "a buffer walk" : "clflush");
+  else
+    printf("latency under cache pressure, ns (median of %d): after a %u KB co-workload / isolated\n",
+           repeats, unsigned(thrashKB));
+
+  printf("%-18s", "kernel");
+  for (int s = 0; s < NumLatencySizes; s++)
+    printf(" %13u", unsigned(LatencySizes[s]));
+  printf("\n");
+
+  for (int k = 0; k < NumKernels; k++)
+  {
+    printf("%-18s", Kernels[k].name);
+    for (int s = 0; s < NumLatencySizes; s++)
+    {
+      size_t size = LatencySizes[s];
+      if (Kernels[k].slow && size > 4096)
+      {
+        printf(" %13s", "-");
+        continue;
+      }
+      double slow = medianTicks(Kernels[k].function, data, size, repeats, disturbed) * scale;
+      double fast = medianTicks(Kernels[k].function, data, size, repeats, quiet)     * scale;
+      printf(" %6.0f/%6.0f", slow, fast);
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+
+/// "short" mode: ns per call for every message size from 1 to 256 bytes, tables evicted before each call,
+/// the PCLMUL kernels against slicing-by-16 (CRCs are compared, too)
+static int benchmarkShort(const char* data, int argc, char** argv)
+{
+  int    repeats  = 51;
+  size_t thrashKB = 0;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+      repeats = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      thrashKB = strtoul(argv[++i], NULL, 0);
+    else
+    {
+      printf("Usage: Crc32 short [-r REPEATS] [-t THRASH_KB (evict with a buffer walk instead of clflush)]\n");
+      return 1;
+    }
+  }
+  if (repeats < 1)
+    repeats = 1;
+  if (ticks() == 0)
+  {
+    printf("this mode needs a time stamp counter\n");
+    return 1;
+  }
+
+  struct ShortKernel
+  {
+    const char*   name;
+    Crc32Function function;
+    Crc32Function reference; // same polynomial
+  };
+  static const ShortKernel ShortKernels[] =
+  {
+    { "16 bytes",   crc32_16bytes,  crc32_bitwise   },
+#ifdef CRC32_PCLMUL
+    { "pclmul",     crc32_clmul,    crc32_bitwise   },
+#endif
+    { "+16 bytes",  crc32c_16bytes, crc32c_halfbyte },
+#ifdef CRC32_SSE42
+    { "+sse4.2",    crc32c_sse42,   crc32c_halfbyte },
+#endif
+#ifdef CRC32_PCLMUL
+    { "+pclmul",    crc32c_clmul,   crc32c_halfbyte },
+#endif
+  };
+  const int NumShortKernels = sizeof(ShortKernels) / sizeof(ShortKernels[0]);
+
+  LatencySetup cold = { !thrashKB, NULL, thrashKB * 1024 };
+  LatencySetup warm = { false, NULL, 0 };
+  std::vector<char> thrash(cold.thrashSize + 1);
+  if (thrashKB)
+    cold.thrash = &thrash[0];
+#if !defined(_MSC_VER) && !defined(__SSE2__)
+  else
+  {
+    printf("clflush not available, use -t\n");
+    return 1;
+  }
+#endif
+
+  // all sizes and a few alignments against the bitwise algorithms
+  int mismatches = 0;
+  for (int k = 0; k < NumShortKernels; k++)
+    for (size_t size = 0; size <= 256; size++)
+      for (size_t offset = 0; offset < 16; offset += 5)
+        if (ShortKernels[k].function(data + offset, size, 0x12345678) != ShortKernels[k].reference(data + offset, size, 0x12345678))
+        {
+          if (mismatches++ < 10)
+            printf("MISMATCH: %s, %u bytes at offset %u\n", ShortKernels[k].name, unsigned(size), unsigned(offset));
+        }
+
+  double scale = 1 / ticksPerNanosecond();
+  printf("ns per call (median of %d), tables evicted by %s / warm\n", repeats, thrashKB ? "a buffer walk" : "clflush");
+  printf("size");
+  for (int k = 0; k < NumShortKernels; k++)
+    printf(" %15s", ShortKernels[k].name);
+  printf("\n");
+  for (size_t size = 1; size <= 256; size++)
+  {
+    printf("%4u", unsigned(size));
+    for (int k = 0; k < NumShortKernels; k++)
+    {
+      double slow = medianTicks(ShortKernels[k].function, data, size, repeats, cold) * scale;
+      double fast = medianTicks(ShortKernels[k].function, data, size, repeats, warm) * scale;
+      printf("   %6.0f/%6.0f", slow, fast);
+    }
+    printf("\n");
+  }
+  return mismatches ? 1 : 0;
+}
+
+
+/// a few random read-modify-writes into the application's working set
+static uint32_t applicationStep(uint32_t* workingSet, size_t mask, uint32_t state, int accesses)
+{
+  for (int i = 0; i < accesses; i++)
+  {
+    state = state * 1664525 + 1013904223;
+    workingSet[(state >> 8) & mask] += state;
+  }
+  return state;
+}
+
+/// "l1" mode: slowdown of an application with an L1-sized working set when CRC calls run between its steps
+static int benchmarkL1(const char* data, int argc, char** argv)
+{
+  size_t workingSetKB = 32, size = 1024;
+  int    accesses = 2000, iterations = 20000;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-w") == 0 && i+1 < argc)
+      workingSetKB = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+      size = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-a") == 0 && i+1 < argc)
+      accesses = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+      iterations = atoi(argv[++i]);
+    else
+    {
+      printf("Usage: Crc32 l1 [-w WORKING_SET_KB (power of 2)] [-s MESSAGE_BYTES] [-a ACCESSES_PER_STEP] [-n STEPS]\n");
+      return 1;
+    }
+  }
+  if (ticks() == 0)
+  {
+    printf("this mode needs a time stamp counter\n");
+    return 1;
+  }
+
+  size_t numWords = 1;
+  while (numWords * 2 <= workingSetKB * 1024 / sizeof(uint32_t))
+    numWords *= 2;
+  std::vector<uint32_t> workingSet(numWords);
+  uint32_t* words = &workingSet[0];
+  double scale = 1 / ticksPerNanosecond();
+
+  printf("application: %u KB working set, %d random updates per step\n",
+         unsigned(numWords * sizeof(uint32_t) / 1024), accesses);
+  printf("one CRC of %u bytes before every other step; steps right after a CRC vs steps after a step:\n", unsigned(size));
+
+  uint32_t state = applicationStep(words, numWords - 1, 1, accesses * 100);
+  for (int k = 0; k < NumKernels; k++)
+  {
+    // interleaved, so that clock changes hit both sides alike
+    uint64_t afterCrc = 0, alone = 0, checksum = 0;
+    volatile uint32_t sink = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+      uint64_t start = ticks();
+      sink = Kernels[k].function(data, size, sink);
+      uint64_t middle = ticks();
+      state = applicationStep(words, numWords - 1, state, accesses);
+      uint64_t end = ticks();
+      state = applicationStep(words, numWords - 1, state, accesses);
+      checksum += middle - start;
+      afterCrc += end - middle;
+      alone    += ticks() - end;
+    }
+    printf("%s: CRC %7.0f ns/call, application %6.0f ns/step after CRC, %6.0f alone, slowdown %+6.1f%%\n",
+           Kernels[k].name, checksum * scale / iterations, afterCrc * scale / iterations, alone * scale / iterations,
+           100.0 * afterCrc / alone - 100);
+  }
+  (void) state;
+  return 0;
+}
+
+
+// //////////////////////////////////////////////////////////
+// prefetch distance sweep on the DRAM-resident buffer
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/// wall-clock time (clock() adds up the CPU time of all threads)
+static double wallSeconds()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// co-workload: stream through a private buffer until told to stop
+static void streamMemory(std::atomic<bool>* stop, size_t size)
+{
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t), 1);
+  volatile uint64_t sink = 0;
+  while (!stop->load(std::memory_order_relaxed))
+  {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < buffer.size(); i += 8)
+      sum += buffer[i];
+    sink = sink + sum;
+  }
+}
+
+/// "prefetch" mode: MB/s of the prefetching kernels per prefetch distance, optionally while other cores
+/// stream through memory, and how long the application needs to re-read its cached data afterwards
+static int benchmarkPrefetch(const char* data, int argc, char** argv)
+{
+  std::vector<size_t> distances;
+  size_t numBytes = NumBytes, appKB = 1024;
+  int competitors = 0;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-d") == 0 && i+1 < argc)
+    {
+      // comma-separated list
+      for (char* next = argv[++i]; *next; )
+      {
+        distances.push_back(strtoul(next, &next, 0));
+        if (*next == ',')
+          next++;
+        else if (*next)
+          break;
+      }
+    }
+    else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+    {
+      numBytes = strtoull(argv[++i], NULL, 0);
+      if (numBytes == 0 || numBytes > NumBytes)
+        numBytes = NumBytes;
+    }
+    else if (strcmp(argv[i], "-c") == 0 && i+1 < argc)
+      competitors = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-a") == 0 && i+1 < argc)
+      appKB = strtoul(argv[++i], NULL, 0);
+    else
+    {
+      printf("Usage: Crc32 prefetch [-d DISTANCE,DISTANCE,...] [-s BYTES] [-c COMPETING_THREADS] [-a APPLICATION_KB]\n");
+      return 1;
+    }
+  }
+  if (distances.empty())
+  {
+    static const size_t Default[] = { 0, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+    distances.assign(Default, Default + sizeof(Default) / sizeof(Default[0]));
+  }
+
+  struct PrefetchKernel
+  {
+    const char*   name;
+    Crc32Function function;
+  };
+  static const PrefetchKernel PrefetchKernels[] =
+  {
+    { " 16 bytes prefetch    ", crc32_16bytes_prefetch     },
+    { " 16 bytes prefetch nta", crc32_16bytes_prefetch_nta },
+#ifdef CRC32_SSE42
+    { "+sse4.2 prefetch      ", crc32c_sse42_prefetch      },
+    { "+sse4.2 prefetch nta  ", crc32c_sse42_prefetch_nta  },
+#endif
+  };
+
+  // the application's data, e.g. an L2-sized working set
+  std::vector<char> application(appKB * 1024 + 64, 1);
+
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < competitors; t++)
+    threads.push_back(std::thread(streamMemory, &stop, size_t(64*1024*1024)));
+  printf("%u MB message, %d competing streaming threads, %u KB application data\n",
+         unsigned(numBytes >> 20), competitors, unsigned(appKB));
+
+  for (size_t k = 0; k < sizeof(PrefetchKernels) / sizeof(PrefetchKernels[0]); k++)
+    for (size_t d = 0; d < distances.size(); d++)
+    {
+      Crc32PrefetchDistance = distances[d];
+      pollute(&application[0], application.size());
+
+      double   startTime = wallSeconds();
+      uint32_t crc       = PrefetchKernels[k].function(data, numBytes, 0);
+      double   duration  = wallSeconds() - startTime;
+
+      // what's left of the application's data in the cache
+      startTime = wallSeconds();
+      pollute(&application[0], application.size());
+      double reload = wallSeconds() - startTime;
+
+      printf("%s, distance %5u: CRC=%08X, %.3fs, %8.3f MB/s, application re-read %7.1f us\n",
+             PrefetchKernels[k].name, unsigned(distances[d]), crc, duration,
+             (numBytes / (1024*1024)) / duration, reload * 1e6);
+    }
+
+  stop = true;
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+  Crc32PrefetchDistance = 1024;
+  return 0;
+}
+
+
+// //////////////////////////////////////////////////////////
+// NUMA placement of the buffer vs crc32_parallel
+
+#ifdef __linux__
+#include <sys/mman.h>
+
+/// "numa" mode: allocate a buffer (optionally on huge pages, interleaved or bound to a node)
+/// and compare one thread, unpinned threads and crc32_parallel's node-aware placement
+static int benchmarkNuma(int argc, char** argv)
+{
+  size_t   numBytes = NumBytes;
+  unsigned numThreads = std::thread::hardware_concurrency();
+  bool     hugePages = false;
+  const char* policy = "local";
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+      numBytes = strtoull(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      numThreads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-H") == 0)
+      hugePages = true;
+    else if (strcmp(argv[i], "-p") == 0 && i+1 < argc)
+      policy = argv[++i];
+    else
+    {
+      printf("Usage: Crc32 numa [-s BYTES] [-t THREADS] [-H (2 MB pages)] [-p local|interleave|bind=NODE]\n");
+      return 1;
+    }
+  }
+  const size_t HugePage = 2*1024*1024;
+  numBytes = (numBytes + HugePage - 1) & ~(HugePage - 1);
+
+  // allocate
+  const char* pages = "4 KB pages";
+  char* data = (char*) MAP_FAILED;
+  if (hugePages)
+  {
+    data = (char*) mmap(NULL, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    pages = "2 MB pages (MAP_HUGETLB)";
+  }
+  if (data == MAP_FAILED)
+  {
+    data = (char*) mmap(NULL, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+    {
+      printf("cannot allocate %u MB: %s\n", unsigned(numBytes >> 20), strerror(errno));
+      return 1;
+    }
+    pages = "4 KB pages";
+    if (hugePages && madvise(data, numBytes, MADV_HUGEPAGE) == 0)
+      pages = "transparent huge pages (MADV_HUGEPAGE)";
+  }
+
+  // NUMA policy before the first touch
+  std::vector<int> nodes;
+  if (!crc32_read_list("/sys/devices/system/node/online", nodes) || nodes.empty())
+    nodes.push_back(0);
+  unsigned long mask[16] = { 0 };
+  int mode = -1;
+  if (strcmp(policy, "interleave") == 0)
+  {
+    mode = MPOL_INTERLEAVE;
+    for (size_t i = 0; i < nodes.size(); i++)
+      if (nodes[i] < 16 * 64)
+        mask[nodes[i] / 64] |= 1UL << (nodes[i] % 64);
+  }
+  else if (strncmp(policy, "bind=", 5) == 0)
+  {
+    mode = MPOL_BIND;
+    int node = atoi(policy + 5);
+    if (node >= 0 && node < 16 * 64)
+      mask[node / 64] |= 1UL << (node % 64);
+  }
+  else if (strcmp(policy, "local") != 0)
+  {
+    printf("unknown policy %s\n", policy);
+    munmap(data, numBytes);
+    return 1;
+  }
+  if (mode >= 0 && syscall(SYS_mbind, data, numBytes, mode, mask, 16 * 64UL, 0) != 0)
+    printf("mbind failed (%s), keeping the default policy\n", strerror(errno));
+
+  for (size_t i = 0; i < numBytes; i++)
+    data[i] = char(i & 0xFF);
+
+  // where did the pieces end up ?
+  std::vector<size_t> perNode;
+  size_t unowned = 0;
+  for (size_t start = 0; start < numBytes; start += Crc32ParallelPiece)
+  {
+    int node = crc32_piece_node(data + start, numBytes - start < Crc32ParallelPiece ? numBytes - start : Crc32ParallelPiece);
+    if (node < 0)
+    {
+      unowned++;
+      continue;
+    }
+    if (size_t(node) >= perNode.size())
+      perNode.resize(node + 1);
+    perNode[node]++;
+  }
+  printf("%u MB on %s, policy %s, %u nodes online, %u threads; 4 MB pieces per node:",
+         unsigned(numBytes >> 20), pages, policy, unsigned(nodes.size()), numThreads);
+  for (size_t n = 0; n < perNode.size(); n++)
+    printf(" %u:%u", unsigned(n), unsigned(perNode[n]));
+  printf(" mixed/unknown:%u\n", unsigned(unowned));
+
+  for (int run = 0; run < 3; run++)
+  {
+    static const char* Names[] = { "one thread      ", "unpinned threads", "NUMA-aware      " };
+    double   startTime = wallSeconds();
+    uint32_t crc = (run == 0) ? crc32_fast(data, numBytes)
+                              : crc32_parallel(data, numBytes, 0, numThreads, crc32_fast, crc32_combine, run == 2);
+    double   duration = wallSeconds() - startTime;
+    printf("%s: CRC=%08X, %.3fs, %.3f MB/s\n", Names[run], crc, duration, (numBytes / (1024*1024)) / duration);
+  }
+
+  munmap(data, numBytes);
+  return 0;
+}
+#endif // __linux__
+
+
+// //////////////////////////////////////////////////////////
+// multi-core scaling: every thread hashes its own buffer
+
+/// what one thread of the scaling benchmark does
+struct ScalingThread
+{
+  Crc32Function      function;
+  bool               privateTables; // slicing-by-16 on a thread-local copy of Crc32Lookup
+  size_t             bufferSize;
+  std::atomic<int>*  state;         // 0 = preparing, 1 = run, 2 = stop
+  std::atomic<int>*  ready;
+  uint64_t           bytes;
+  double             duration;
+  uint32_t           crc;
+};
+
+static void scalingWorker(ScalingThread* work)
+{
+  // first touch by this thread: buffer and table copy end up on its NUMA node
+  std::vector<char> buffer(work->bufferSize);
+  for (size_t i = 0; i < buffer.size(); i++)
+    buffer[i] = char(i & 0xFF);
+  std::vector<uint32_t> copy(work->privateTables ? 16*256 : 0);
+  if (work->privateTables)
+    memcpy(&copy[0], Crc32Lookup, sizeof(Crc32Lookup));
+  const uint32_t (*table)[256] = (const uint32_t (*)[256]) (work->privateTables ? &copy[0] : NULL);
+
+  (*work->ready)++;
+  while (work->state->load() == 0)
+    std::this_thread::yield();
+
+  uint32_t crc = 0;
+  uint64_t bytes = 0;
+  double startTime = wallSeconds();
+  while (work->state->load(std::memory_order_relaxed) == 1)
+  {
+    if (table)
+    {
+      // same as crc32_16bytes, buffer sizes are multiples of 16
+      uint32_t state = ~crc;
+      const uint32_t* current = (const uint32_t*) &buffer[0];
+      for (size_t length = buffer.size(); length >= 16; length -= 16, current += 4)
+        state = crc32_slice16(table, current, state);
+      crc = ~state;
+    }
+    else
+      crc = work->function(&buffer[0], buffer.size(), crc);
+    bytes += buffer.size();
+  }
+  work->duration = wallSeconds() - startTime;
+  work->bytes    = bytes;
+  work->crc      = crc;
+}
+
+/// "scaling" mode: aggregate and per-thread GB/s for 1..N threads, shared vs per-thread tables,
+/// cache- vs DRAM-resident buffers, and the thread count where the curve flattens
+static int benchmarkScaling(int argc, char** argv)
+{
+  unsigned maxThreads = std::thread::hardware_concurrency();
+  const char* kernelName = " 16 bytes at once";
+  double   runTime = 0.2;
+  std::vector<size_t> bufferSizes;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      maxThreads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-k") == 0 && i+1 < argc)
+      kernelName = argv[++i];
+    else if (strcmp(argv[i], "-w") == 0 && i+1 < argc)
+      bufferSizes.push_back((strtoul(argv[++i], NULL, 0) * 1024 + 15) & ~size_t(15));
+    else if (strcmp(argv[i], "-d") == 0 && i+1 < argc)
+      runTime = atof(argv[++i]);
+    else
+    {
+      printf("Usage: Crc32 scaling [-t MAX_THREADS] [-k KERNEL_NAME_PART] [-w KB_PER_THREAD]... [-d SECONDS_PER_POINT]\n");
+      return 1;
+    }
+  }
+  if (maxThreads < 1)
+    maxThreads = 1;
+  if (bufferSizes.empty())
+  {
+    bufferSizes.push_back(256*1024);      // L2/L3-resident
+    bufferSizes.push_back(64*1024*1024);  // DRAM-resident
+  }
+  const Kernel* kernel = NULL;
+  for (int k = 0; k < NumKernels && !kernel; k++)
+    if (strstr(Kernels[k].name, kernelName))
+      kernel = &Kernels[k];
+  if (!kernel)
+  {
+    printf("no kernel matches '%s'\n", kernelName);
+    return 1;
+  }
+  // each point costs runTime, sample large machines more coarsely
+  unsigned step = maxThreads > 32 ? maxThreads / 32 : 1;
+
+  for (size_t b = 0; b < bufferSizes.size(); b++)
+    for (int privateTables = 0; privateTables < 2; privateTables++)
+    {
+      printf("\n%s, %u KB per thread, %s tables\n", privateTables ? "slicing-by-16" : kernel->name,
+             unsigned(bufferSizes[b] / 1024), privateTables ? "per-thread" : "shared");
+      printf("threads  aggregate GB/s  per thread GB/s  efficiency\n");
+
+      double single = 0, previous = 0;
+      unsigned knee = 1, previousThreads = 0;
+      bool flattened = false;
+      for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads = (numThreads == 1 && step > 1) ? step : numThreads + step)
+      {
+        std::atomic<int> state(0), ready(0);
+        std::vector<ScalingThread> work(numThreads);
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < numThreads; t++)
+        {
+          ScalingThread setup = { kernel->function, privateTables != 0, bufferSizes[b], &state, &ready, 0, 0, 0 };
+          work[t] = setup;
+          threads.push_back(std::thread(scalingWorker, &work[t]));
+        }
+        while (ready.load() < int(numThreads))
+          std::this_thread::yield();
+        state = 1;
+        std::this_thread::sleep_for(std::chrono::duration<double>(runTime));
+        state = 2;
+        for (unsigned t = 0; t < numThreads; t++)
+          threads[t].join();
+
+        double aggregate = 0;
+        for (unsigned t = 0; t < numThreads; t++)
+          aggregate += work[t].bytes / work[t].duration / 1e9;
+        if (numThreads == 1)
+          single = aggregate;
+        printf("%5u    %10.3f      %10.3f       %5.1f%%\n", numThreads, aggregate, aggregate / numThreads,
+               100 * aggregate / (single * numThreads));
+
+        // knee: the last point before the added threads brought less than half a core's worth each
+        if (!flattened && numThreads > 1)
+        {
+          if ((aggregate - previous) / (numThreads - previousThreads) >= 0.5 * single)
+            knee = numThreads;
+          else
+            flattened = true;
+        }
+        previous = aggregate, previousThreads = numThreads;
+      }
+      printf("knee of the curve: %u threads (adding more yields less than half a core each)\n", knee);
+    }
+  return 0;
+}
+
+
+// //////////////////////////////////////////////////////////
+// replay a production mix of call sizes, alignments and polynomials
+
+#include <cmath>
+#include <errno.h>
+
+/// one call of the trace
+struct ReplayCall
+{
+  uint32_t length;
+  uint16_t alignment;   // start address modulo 64
+  bool     castagnoli;  // CRC32C instead of CRC32
+  size_t   offset;      // where in the buffer, same for all configurations
+};
+
+/// kernels used for CRC32 and CRC32C calls
+struct ReplayConfig
+{
+  const char*   name;
+  Crc32Function crc32;
+  Crc32Function crc32c;
+};
+
+static uint32_t crc32c_8bytes_inverted(const void* data, size_t length, uint32_t previousCrc32)
+{
+  return ~crc32cSlicingBy8(data, length, ~previousCrc32);
+}
+
+static uint32_t crc32c_4x4bytes_inverted(const void* data, size_t length, uint32_t previousCrc32)
+{
+  return ~crc32cSlicingBy4x4(data, length, ~previousCrc32);
+}
+
+static const ReplayConfig ReplayConfigs[] =
+{
+  { "slicing-by-16 (16 KB)", crc32_2x16bytes, crc32c_16bytes           },
+  { "slicing-by-8   (8 KB)", crc32_8bytes,    crc32c_8bytes_inverted   },
+  { "slicing-by-4   (4 KB)", crc32_4x4bytes,  crc32c_4x4bytes_inverted },
+#ifdef __SSSE3__
+  { "half-byte     (64 B) ", crc32_halfbyte_simd, crc32c_halfbyte    },
+#else
+  { "half-byte     (64 B) ", crc32_halfbyte,  crc32c_halfbyte          },
+#endif
+  { "crc32_fast/crc32c_fast", crc32_fast,     crc32c_fast              },
+};
+
+/// xorshift64*, reproducible across runs
+static uint64_t replayRandom(uint64_t& state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 2685821657736338717ULL;
+}
+
+/// read "length [alignment [crc32|crc32c]]" lines (whitespace or commas, # starts a comment)
+static bool readTrace(const char* filename, std::vector<ReplayCall>& calls)
+{
+  FILE* file = fopen(filename, "r");
+  if (!file)
+  {
+    printf("cannot open %s: %s\n", filename, strerror(errno));
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file))
+  {
+    for (char* c = line; *c; c++)
+      if (*c == ',')
+        *c = ' ';
+    char* comment = strchr(line, '#');
+    if (comment)
+      *comment = 0;
+
+    unsigned long length, alignment = 0;
+    char polynomial[16] = "crc32";
+    if (sscanf(line, "%lu %lu %15s", &length, &alignment, polynomial) < 1)
+      continue;
+    ReplayCall call = { uint32_t(length), uint16_t(alignment % 64),
+                        strcmp(polynomial, "crc32c") == 0 || strcmp(polynomial, "c") == 0, 0 };
+    calls.push_back(call);
+  }
+  fclose(file);
+  return true;
+}
+
+/// "WEIGHT:MIN-MAX,..." buckets, lengths log-uniform within a bucket
+static bool generateTrace(const char* spec, size_t numCalls, int alignment, int castagnoliPercent,
+                          std::vector<ReplayCall>& calls)
+{
+  struct Bucket { double weight, minimum, maximum; };
+  std::vector<Bucket> buckets;
+  double total = 0;
+  for (const char* next = spec; *next; )
+  {
+    Bucket bucket;
+    char* end;
+    bucket.weight = strtod(next, &end);
+    if (*end != ':')
+      return false;
+    bucket.minimum = strtod(end + 1, &end);
+    if (*end != '-')
+      return false;
+    bucket.maximum = strtod(end + 1, &end);
+    if (bucket.weight <= 0 || bucket.minimum < 1 || bucket.maximum < bucket.minimum)
+      return false;
+    buckets.push_back(bucket);
+    total += bucket.weight;
+    next = (*end == ',') ? end + 1 : end;
+    if (*end && *end != ',')
+      return false;
+  }
+  if (buckets.empty())
+    return false;
+
+  uint64_t random = 0x9E3779B97F4A7C15ULL;
+  for (size_t i = 0; i < numCalls; i++)
+  {
+    double pick = (replayRandom(random) >> 11) * (1.0 / 9007199254740992.0) * total;
+    size_t b = 0;
+    while (b + 1 < buckets.size() && pick >= buckets[b].weight)
+      pick -= buckets[b++].weight;
+    double u = (replayRandom(random) >> 11) * (1.0 / 9007199254740992.0);
+    double length = exp(log(buckets[b].minimum) + u * (log(buckets[b].maximum) - log(buckets[b].minimum)));
+
+    ReplayCall call;
+    call.length     = uint32_t(length + 0.5);
+    call.alignment  = uint16_t(alignment >= 0 ? alignment % 64 : replayRandom(random) % 64);
+    call.castagnoli = int(replayRandom(random) % 100) < castagnoliPercent;
+    call.offset     = 0;
+    calls.push_back(call);
+  }
+  return true;
+}
+
+/// "replay" mode: run a trace (or a parametric size distribution) against each kernel configuration,
+/// report total time, ns/call percentiles and bytes/s
+static int benchmarkReplay(const char* data, int argc, char** argv)
+{
+  const char* traceFile = NULL;
+  const char* spec = "70:1-256,25:256-65536,5:65536-4194304";
+  const char* only = "";
+  size_t numCalls = 100000, window = 16*1024*1024;
+  int alignment = -1, castagnoliPercent = 0, repeats = 1;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-f") == 0 && i+1 < argc)
+      traceFile = argv[++i];
+    else if (strcmp(argv[i], "-D") == 0 && i+1 < argc)
+      spec = argv[++i];
+    else if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+      numCalls = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-a") == 0 && i+1 < argc)
+      alignment = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-c") == 0 && i+1 < argc)
+      castagnoliPercent = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-W") == 0 && i+1 < argc)
+      window = strtoul(argv[++i], NULL, 0) * 1024 * 1024;
+    else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+      repeats = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-k") == 0 && i+1 < argc)
+      only = argv[++i];
+    else
+    {
+      printf("Usage: Crc32 replay [-f TRACE_FILE | -D WEIGHT:MIN-MAX,... [-n CALLS] [-a ALIGNMENT] [-c CRC32C_PERCENT]]\n"
+             "                    [-W WINDOW_MB] [-r REPEATS] [-k CONFIG_NAME_PART]\n"
+             "trace lines: LENGTH [ALIGNMENT [crc32|crc32c]]\n");
+      return 1;
+    }
+  }
+  if (ticks() == 0)
+  {
+    printf("this mode needs a time stamp counter\n");
+    return 1;
+  }
+
+  std::vector<ReplayCall> calls;
+  if (traceFile ? !readTrace(traceFile, calls) : !generateTrace(spec, numCalls, alignment, castagnoliPercent, calls))
+  {
+    if (!traceFile)
+      printf("bad distribution '%s', expected WEIGHT:MIN-MAX,...\n", spec);
+    return 1;
+  }
+  if (calls.empty())
+  {
+    printf("empty trace\n");
+    return 1;
+  }
+
+  // spread the calls over a window of the buffer (cache-line granularity plus their alignment)
+  if (window > NumBytes)
+    window = NumBytes;
+  uint64_t random = 12345;
+  uint64_t totalBytes = 0;
+  size_t   numCastagnoli = 0;
+  for (size_t i = 0; i < calls.size(); i++)
+  {
+    ReplayCall& call = calls[i];
+    if (call.length > NumBytes - 64)
+      call.length = uint32_t(NumBytes - 64);
+    size_t room = window > call.length + 64 ? window - call.length - 64 : 0;
+    call.offset = (room ? (replayRandom(random) % room) & ~size_t(63) : 0) + call.alignment;
+    totalBytes    += call.length;
+    numCastagnoli += call.castagnoli;
+  }
+  printf("%u calls (%u CRC32C), %.1f MB in total, %.0f bytes on average, %u MB window\n",
+         unsigned(calls.size()), unsigned(numCastagnoli), totalBytes / (1024.0*1024), double(totalBytes) / calls.size(),
+         unsigned(window >> 20));
+
+  double scale = 1 / ticksPerNanosecond();
+  std::vector<uint64_t> durations(calls.size());
+  for (size_t c = 0; c < sizeof(ReplayConfigs) / sizeof(ReplayConfigs[0]); c++)
+  {
+    const ReplayConfig& config = ReplayConfigs[c];
+    if (!strstr(config.name, only))
+      continue;
+    for (int r = 0; r < repeats; r++)
+    {
+      uint32_t checksum = 0;
+      uint64_t sum = 0;
+      double startTime = wallSeconds();
+      for (size_t i = 0; i < calls.size(); i++)
+      {
+        const ReplayCall& call = calls[i];
+        uint64_t start = ticks();
+        checksum ^= (call.castagnoli ? config.crc32c : config.crc32)(data + call.offset, call.length, 0);
+        durations[i] = ticks() - start;
+        sum += durations[i];
+      }
+      double wall = wallSeconds() - startTime;
+
+      std::sort(durations.begin(), durations.end());
+      size_t last = durations.size() - 1;
+      printf("%s: CRCs %08X, total %.3f ms (%.3f ms wall), ns/call p50 %.0f p90 %.0f p99 %.0f p99.9 %.0f max %.0f, %.1f MB/s\n",
+             config.name, checksum, sum * scale / 1e6, wall * 1e3,
+             durations[last / 2] * scale, durations[last * 90 / 100] * scale, durations[last * 99 / 100] * scale,
+             durations[last * 999 / 1000] * scale, durations[last] * scale,
+             totalBytes / (sum * scale / 1e9) / (1024*1024));
+    }
+  }
+  return 0;
+}
+
+
+// //////////////////////////////////////////////////////////
+// machine-readable results (JSON or CSV) and comparison against a stored baseline
+
+#include <string>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+/// one kernel at one size and alignment
+struct BenchmarkRecord
+{
+  std::string kernel, polynomial, cpu, compiler, flags;
+  size_t      size;
+  int         alignment;
+  double      medianNs, madNs;  // median and median absolute deviation of the per-call time
+  double      cyclesPerByte;    // TSC reference cycles
+  uint32_t    crc;
+};
+
+static const size_t RecordSizes[] = { 16, 64, 256, 1024, 4096, 65536, 1024*1024 };
+static const int    RecordAlignments[] = { 0, 1 };
+
+/// CPU brand string
+static std::string cpuModel()
+{
+  char brand[49] = { 0 };
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+  unsigned int regs[12];
+  if (__get_cpuid(0x80000004, &regs[0], &regs[1], &regs[2], &regs[3]))
+  {
+    __get_cpuid(0x80000002, &regs[0], &regs[1], &regs[2],  &regs[3]);
+    __get_cpuid(0x80000003, &regs[4], &regs[5], &regs[6],  &regs[7]);
+    __get_cpuid(0x80000004, &regs[8], &regs[9], &regs[10], &regs[11]);
+    memcpy(brand, regs, 48);
+  }
+#elif defined(_MSC_VER)
+  int regs[12];
+  __cpuid(regs,     0x80000002);
+  __cpuid(regs + 4, 0x80000003);
+  __cpuid(regs + 8, 0x80000004);
+  memcpy(brand, regs, 48);
+#else
+  FILE* cpuinfo = fopen("/proc/cpuinfo", "r");
+  char line[256];
+  while (cpuinfo && fgets(line, sizeof(line), cpuinfo))
+    if (strncmp(line, "model name", 10) == 0 && strchr(line, ':'))
+    {
+      strncpy(brand, strchr(line, ':') + 2, sizeof(brand) - 1);
+      break;
+    }
+  if (cpuinfo)
+    fclose(cpuinfo);
+#endif
+  std::string model(brand);
+  while (!model.empty() && (model[0] == ' '))
+    model.erase(0, 1);
+  while (!model.empty() && (model[model.size()-1] == ' ' || model[model.size()-1] == '\n'))
+    model.erase(model.size() - 1);
+  return model.empty() ? "unknown" : model;
+}
 
-  // eight bytes at once, process in 4k chunks
-  startTime = seconds();
-  crc = 0; // also default parameter of crc32_xx functions
-  size_t bytesProcessed = 0;
-  while (bytesProcessed < NumBytes)
+/// compiler and the code generation options visible to the preprocessor;
+/// the build can pass the exact command line with -DCRC32_COMPILER_FLAGS="\"...\""
+static std::string compilerName()
+{
+#if defined(__clang__)
+  return "clang " __clang_version__;
+#elif defined(__GNUC__)
+  return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+  char version[32];
+  snprintf(version, sizeof(version), "MSVC %d", _MSC_VER);
+  return version;
+#else
+  return "unknown";
+#endif
+}
+
+static std::string compilerFlags()
+{
+#ifdef CRC32_COMPILER_FLAGS
+  return CRC32_COMPILER_FLAGS;
+#else
+  std::string flags;
+#ifdef __OPTIMIZE__
+  flags += " -O";
+#endif
+#ifdef __SSSE3__
+  flags += " ssse3";
+#endif
+#ifdef __SSE4_2__
+  flags += " sse4.2";
+#endif
+#ifdef __PCLMUL__
+  flags += " pclmul";
+#endif
+#ifdef __AVX2__
+  flags += " avx2";
+#endif
+#ifdef __AVX512F__
+  flags += " avx512f";
+#endif
+#ifdef CRC32_STATS
+  flags += " -DCRC32_STATS";
+#endif
+  char footprint[48];
+  snprintf(footprint, sizeof(footprint), " -DCRC32_TABLE_FOOTPRINT=%d", CRC32_TABLE_FOOTPRINT);
+  flags += footprint;
+  return flags.substr(1);
+#endif
+}
+
+/// measure all kernels (or those whose name contains only) at RecordSizes x RecordAlignments
+static void measureRecords(const char* data, int repeats, const char* only, std::vector<BenchmarkRecord>& records)
+{
+  double scale = 1 / ticksPerNanosecond();
+  std::string cpu = cpuModel(), compiler = compilerName(), flags = compilerFlags();
+  std::vector<double> samples(repeats), deviations(repeats);
+  for (int k = 0; k < NumKernels; k++)
   {
-    size_t bytesLeft = NumBytes - bytesProcessed;
-    size_t chunkSize = (DefaultChunkSize < bytesLeft) ? DefaultChunkSize : bytesLeft;
+    if (!strstr(Kernels[k].name, only))
+      continue;
+    for (size_t s = 0; s < sizeof(RecordSizes) / sizeof(RecordSizes[0]); s++)
+      for (size_t a = 0; a < sizeof(RecordAlignments) / sizeof(RecordAlignments[0]); a++)
+      {
+        size_t size = RecordSizes[s];
+        if (Kernels[k].slow && size > 4096)
+          continue;
+        const char* start = data + RecordAlignments[a];
+        // enough calls per sample to dwarf the timer overhead
+        int calls = int(65536 / size) + 1;
+        volatile uint32_t sink = 0;
+        for (int r = -1; r < repeats; r++)
+        {
+          uint64_t begin = ticks();
+          for (int i = 0; i < calls; i++)
+            sink = Kernels[k].function(start, size, sink);
+          double ns = (ticks() - begin) * scale / calls;
+          if (r >= 0) // first round warms up
+            samples[r] = ns;
+        }
+        std::sort(samples.begin(), samples.end());
+        double median = samples[repeats / 2];
+        for (int r = 0; r < repeats; r++)
+          deviations[r] = fabs(samples[r] - median);
+        std::sort(deviations.begin(), deviations.end());
+
+        BenchmarkRecord record;
+        const char* name = Kernels[k].name;
+        record.polynomial = (*name == '+') ? "crc32c" : "crc32";
+        while (*name == '+' || *name == ' ')
+          name++;
+        record.kernel        = name;
+        record.size          = size;
+        record.alignment     = RecordAlignments[a];
+        record.medianNs      = median;
+        record.madNs         = deviations[repeats / 2];
+        record.cyclesPerByte = median / scale / size;
+        record.crc           = Kernels[k].function(start, size, 0);
+        record.cpu = cpu, record.compiler = compiler, record.flags = flags;
+        records.push_back(record);
+      }
+  }
+}
 
-    crc = crc32_8bytes(data, chunkSize, crc);
+/// JSON string with quotes and backslashes escaped
+static std::string jsonString(const std::string& text)
+{
+  std::string result = "\"";
+  for (size_t i = 0; i < text.size(); i++)
+  {
+    if (text[i] == '"' || text[i] == '\\')
+      result += '\\';
+    result += text[i];
+  }
+  return result + "\"";
+}
 
-    bytesProcessed += chunkSize;
+/// CSV field, quoted if needed
+static std::string csvString(const std::string& text)
+{
+  if (text.find_first_of(",\"\n") == std::string::npos)
+    return text;
+  std::string result = "\"";
+  for (size_t i = 0; i < text.size(); i++)
+  {
+    if (text[i] == '"')
+      result += '"';
+    result += text[i];
   }
-  duration  = seconds() - startTime;
-  printf("chunked        : CRC=%08X, %.3fs, %.3f MB/s\n",
-    crc, duration, (NumBytes / (1024*1024)) / duration);
+  return result + "\"";
+}
 
-  delete[] data;
+static const char* CsvHeader = "kernel,polynomial,size,alignment,median_ns,mad_ns,cycles_per_byte,crc,cpu,compiler,flags";
+
+/// JSON: an array with one object per line
+static bool writeRecords(const char* filename, bool csv, const std::vector<BenchmarkRecord>& records)
+{
+  FILE* file = (!filename || strcmp(filename, "-") == 0) ? stdout : fopen(filename, "w");
+  if (!file)
+  {
+    printf("cannot create %s: %s\n", filename, strerror(errno));
+    return false;
+  }
+  if (csv)
+    fprintf(file, "%s\n", CsvHeader);
+  else
+    fprintf(file, "[\n");
+  for (size_t i = 0; i < records.size(); i++)
+  {
+    const BenchmarkRecord& record = records[i];
+    if (csv)
+      fprintf(file, "%s,%s,%u,%d,%.3f,%.3f,%.4f,%08X,%s,%s,%s\n",
+              csvString(record.kernel).c_str(), record.polynomial.c_str(), unsigned(record.size), record.alignment,
+              record.medianNs, record.madNs, record.cyclesPerByte, record.crc,
+              csvString(record.cpu).c_str(), csvString(record.compiler).c_str(), csvString(record.flags).c_str());
+    else
+      fprintf(file, "{\"kernel\": %s, \"polynomial\": \"%s\", \"size\": %u, \"alignment\": %d, \"median_ns\": %.3f, "
+                    "\"mad_ns\": %.3f, \"cycles_per_byte\": %.4f, \"crc\": \"%08X\", \"cpu\": %s, \"compiler\": %s, \"flags\": %s}%s\n",
+              jsonString(record.kernel).c_str(), record.polynomial.c_str(), unsigned(record.size), record.alignment,
+              record.medianNs, record.madNs, record.cyclesPerByte, record.crc,
+              jsonString(record.cpu).c_str(), jsonString(record.compiler).c_str(), jsonString(record.flags).c_str(),
+              i + 1 < records.size() ? "," : "");
+  }
+  if (!csv)
+    fprintf(file, "]\n");
+  if (file != stdout)
+    fclose(file);
+  return true;
+}
+
+/// value of "key": in a line written by writeRecords (string or number), empty if missing
+static std::string jsonField(const char* line, const char* key)
+{
+  std::string pattern = std::string("\"") + key + "\": ";
+  const char* found = strstr(line, pattern.c_str());
+  if (!found)
+    return "";
+  const char* value = found + pattern.size();
+  std::string result;
+  if (*value != '"')
+  {
+    while (*value && *value != ',' && *value != '}')
+      result += *value++;
+    return result;
+  }
+  for (value++; *value && *value != '"'; value++)
+  {
+    if (*value == '\\' && value[1])
+      value++;
+    result += *value;
+  }
+  return result;
+}
+
+/// split a CSV line, honoring quotes
+static std::vector<std::string> csvFields(const char* line)
+{
+  std::vector<std::string> fields(1);
+  bool quoted = false;
+  for (; *line && *line != '\n' && *line != '\r'; line++)
+  {
+    if (quoted && *line == '"' && line[1] == '"')
+      fields.back() += *++line;
+    else if (*line == '"')
+      quoted = !quoted;
+    else if (*line == ',' && !quoted)
+      fields.push_back("");
+    else
+      fields.back() += *line;
+  }
+  return fields;
+}
+
+/// load a file written by writeRecords, JSON or CSV (detected by its first character)
+static bool readRecords(const char* filename, std::vector<BenchmarkRecord>& records)
+{
+  FILE* file = fopen(filename, "r");
+  if (!file)
+  {
+    printf("cannot open %s: %s\n", filename, strerror(errno));
+    return false;
+  }
+  char line[4096];
+  std::vector<std::string> header;
+  bool csv = false, first = true;
+  while (fgets(line, sizeof(line), file))
+  {
+    if (first)
+    {
+      first = false;
+      csv = (line[0] != '[' && line[0] != '{');
+      if (csv)
+      {
+        header = csvFields(line);
+        continue;
+      }
+    }
+
+    std::vector<std::string> fields;
+    if (csv)
+      fields = csvFields(line);
+    else if (!strstr(line, "\"kernel\""))
+      continue;
+    // by column name, so that files with extra or reordered columns still load
+    struct Lookup
+    {
+      static std::string get(bool csv, const char* line, const std::vector<std::string>& header,
+                             const std::vector<std::string>& fields, const char* key)
+      {
+        if (!csv)
+          return jsonField(line, key);
+        for (size_t i = 0; i < header.size() && i < fields.size(); i++)
+          if (header[i] == key)
+            return fields[i];
+        return "";
+      }
+    };
+    BenchmarkRecord record;
+    record.kernel        = Lookup::get(csv, line, header, fields, "kernel");
+    record.polynomial    = Lookup::get(csv, line, header, fields, "polynomial");
+    record.size          = strtoul(Lookup::get(csv, line, header, fields, "size").c_str(), NULL, 10);
+    record.alignment     = atoi   (Lookup::get(csv, line, header, fields, "alignment").c_str());
+    record.medianNs      = atof   (Lookup::get(csv, line, header, fields, "median_ns").c_str());
+    record.madNs         = atof   (Lookup::get(csv, line, header, fields, "mad_ns").c_str());
+    record.cyclesPerByte = atof   (Lookup::get(csv, line, header, fields, "cycles_per_byte").c_str());
+    record.crc           = uint32_t(strtoul(Lookup::get(csv, line, header, fields, "crc").c_str(), NULL, 16));
+    record.cpu           = Lookup::get(csv, line, header, fields, "cpu");
+    record.compiler      = Lookup::get(csv, line, header, fields, "compiler");
+    record.flags         = Lookup::get(csv, line, header, fields, "flags");
+    if (!record.kernel.empty() && record.size > 0)
+      records.push_back(record);
+  }
+  fclose(file);
+  return true;
+}
+
+/// "record" mode: measure and write JSON (default) or CSV, "-o -" writes to stdout
+static int benchmarkRecord(const char* data, int argc, char** argv)
+{
+  const char* output = "benchmark.json";
+  const char* only   = "";
+  bool csv = false;
+  int repeats = 15;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+    {
+      output = argv[++i];
+      size_t length = strlen(output);
+      csv = length > 4 && strcmp(output + length - 4, ".csv") == 0;
+    }
+    else if (strcmp(argv[i], "-F") == 0 && i+1 < argc)
+      csv = strcmp(argv[++i], "csv") == 0;
+    else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+      repeats = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-k") == 0 && i+1 < argc)
+      only = argv[++i];
+    else
+    {
+      printf("Usage: Crc32 record [-o FILE (default benchmark.json, *.csv = CSV)] [-F json|csv] [-r REPEATS] [-k KERNEL_NAME_PART]\n");
+      return 1;
+    }
+  }
+  if (ticks() == 0)
+  {
+    printf("this mode needs a time stamp counter\n");
+    return 1;
+  }
+  if (repeats < 3)
+    repeats = 3;
+
+  std::vector<BenchmarkRecord> records;
+  measureRecords(data, repeats, only, records);
+  if (!writeRecords(output, csv, records))
+    return 1;
+  printf("%u records written to %s\n", unsigned(records.size()), output);
+  return 0;
+}
+
+/// "compare" mode: measure (or load with -i) and flag kernels that got significantly slower than the baseline;
+/// exit code 1 if any did or if a CRC changed
+static int benchmarkCompare(const char* data, int argc, char** argv)
+{
+  const char* baselineFile = NULL;
+  const char* currentFile  = NULL;
+  const char* output = NULL;
+  const char* only   = "";
+  double threshold = 5;
+  int repeats = 15;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-i") == 0 && i+1 < argc)
+      currentFile = argv[++i];
+    else if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+      output = argv[++i];
+    else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      threshold = atof(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+      repeats = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-k") == 0 && i+1 < argc)
+      only = argv[++i];
+    else if (argv[i][0] != '-' && !baselineFile)
+      baselineFile = argv[i];
+    else
+      baselineFile = NULL, argc = 0;
+  }
+  if (!baselineFile)
+  {
+    printf("Usage: Crc32 compare BASELINE [-i CURRENT | -r REPEATS -k KERNEL_NAME_PART -o SAVE_AS] [-t PERCENT]\n");
+    return 1;
+  }
+
+  std::vector<BenchmarkRecord> baseline, current;
+  if (!readRecords(baselineFile, baseline))
+    return 1;
+  if (currentFile)
+  {
+    if (!readRecords(currentFile, current))
+      return 1;
+  }
+  else
+  {
+    if (ticks() == 0)
+    {
+      printf("this mode needs a time stamp counter\n");
+      return 1;
+    }
+    measureRecords(data, repeats < 3 ? 3 : repeats, only, current);
+    if (output)
+    {
+      size_t length = strlen(output);
+      writeRecords(output, length > 4 && strcmp(output + length - 4, ".csv") == 0, current);
+    }
+  }
+  if (!baseline.empty() && !current.empty())
+  {
+    if (baseline[0].cpu != current[0].cpu)
+      printf("note: CPU differs (baseline %s, now %s)\n", baseline[0].cpu.c_str(), current[0].cpu.c_str());
+    if (baseline[0].compiler != current[0].compiler || baseline[0].flags != current[0].flags)
+      printf("note: compiler or flags differ (baseline %s / %s, now %s / %s)\n", baseline[0].compiler.c_str(),
+             baseline[0].flags.c_str(), current[0].compiler.c_str(), current[0].flags.c_str());
+  }
+
+  int slower = 0, faster = 0, wrong = 0, compared = 0, missing = 0;
+  std::vector<bool> matched(baseline.size(), false);
+  for (size_t c = 0; c < current.size(); c++)
+  {
+    const BenchmarkRecord& now = current[c];
+    const BenchmarkRecord* before = NULL;
+    for (size_t b = 0; b < baseline.size() && !before; b++)
+      if (baseline[b].kernel == now.kernel && baseline[b].polynomial == now.polynomial &&
+          baseline[b].size == now.size && baseline[b].alignment == now.alignment)
+        before = &baseline[b], matched[b] = true;
+    if (!before)
+      continue;
+    compared++;
+
+    if (before->crc != now.crc)
+    {
+      printf("CRC CHANGED %-22s %-6s %7u bytes +%d: %08X -> %08X\n", now.kernel.c_str(), now.polynomial.c_str(),
+             unsigned(now.size), now.alignment, before->crc, now.crc);
+      wrong++;
+    }
+    // significant: beyond the threshold and beyond 3 sigma of both runs' noise (MAD * 1.4826 ~ sigma)
+    double difference = now.medianNs - before->medianNs;
+    double noise = 3 * 1.4826 * sqrt(now.madNs * now.madNs + before->madNs * before->madNs);
+    double percent = 100 * difference / before->medianNs;
+    if (fabs(percent) < threshold || fabs(difference) <= noise)
+      continue;
+    if (difference > 0)
+    {
+      printf("SLOWER      %-22s %-6s %7u bytes +%d: %10.1f -> %10.1f ns (%+.1f%%)\n", now.kernel.c_str(),
+             now.polynomial.c_str(), unsigned(now.size), now.alignment, before->medianNs, now.medianNs, percent);
+      slower++;
+    }
+    else
+      faster++;
+  }
+
+  // kernels that were renamed, removed or not compiled in (only those selected by -k)
+  for (size_t b = 0; b < baseline.size(); b++)
+    if (!matched[b] && strstr(baseline[b].kernel.c_str(), only))
+    {
+      printf("MISSING     %-22s %-6s %7u bytes +%d\n", baseline[b].kernel.c_str(), baseline[b].polynomial.c_str(),
+             unsigned(baseline[b].size), baseline[b].alignment);
+      missing++;
+    }
+
+  printf("%d measurements compared: %d significantly slower, %d significantly faster, %d CRC changes, "
+         "%d missing (threshold %.1f%%)\n", compared, slower, faster, wrong, missing, threshold);
+  // an empty or unreadable baseline or a -k that matches nothing must not pass as "no regressions"
+  if (compared == 0)
+  {
+    printf("nothing compared: %u baseline and %u current records have no measurement in common\n",
+           unsigned(baseline.size()), unsigned(current.size()));
+    return 1;
+  }
+  return (slower || wrong) ? 1 : 0;
+}
+
+
+// //////////////////////////////////////////////////////////
+// hash join: open-addressing build and probe with different hash functions
+
+#include <functional>
+
+/// linear probing, keys with payload; a slot is free if its payload is ~0
+struct JoinTable
+{
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> payloads;
+  uint64_t              mask;
+  uint64_t              probes;   // slots inspected, to compare hash quality
+};
+
+template <typename Hash>
+static void joinBuild(JoinTable& table, const uint64_t* keys, const Hash* hashes, size_t numKeys)
+{
+  for (size_t i = 0; i < numKeys; i++)
+  {
+    uint64_t slot = hashes[i] & table.mask;
+    while (table.payloads[slot] != ~0u && table.keys[slot] != keys[i])
+      slot = (slot + 1) & table.mask, table.probes++;
+    table.keys[slot] = keys[i], table.payloads[slot] = uint32_t(i);
+  }
+}
+
+template <typename Hash>
+static size_t joinProbe(JoinTable& table, const uint64_t* keys, const Hash* hashes, size_t numKeys)
+{
+  size_t matches = 0;
+  for (size_t i = 0; i < numKeys; i++)
+  {
+    uint64_t slot = hashes[i] & table.mask;
+    for (; table.payloads[slot] != ~0u; slot = (slot + 1) & table.mask, table.probes++)
+      if (table.keys[slot] == keys[i])
+      {
+        matches++;
+        break;
+      }
+  }
+  return matches;
+}
+
+/// "hash" mode: hash-join build and probe of 64-bit keys with std::hash, crc32cSlicingBy8 per key
+/// and the bulk crc32c_hash_u64, on random and on strided keys
+static int benchmarkHash(int argc, char** argv)
+{
+  size_t numKeys = 1 << 22;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+      numKeys = strtoul(argv[++i], NULL, 0);
+    else
+    {
+      printf("Usage: Crc32 hash [-n KEYS]\n");
+      return 1;
+    }
+  }
+  if (numKeys < 16)
+    numKeys = 16;
+  size_t capacity = 1;
+  while (capacity < 2 * numKeys)
+    capacity *= 2;
+
+  // build keys, probe keys: every other one is in the table
+  std::vector<uint64_t> build(numKeys), probe(numKeys);
+  std::vector<uint32_t> hashes32(numKeys), hashes32u(numKeys), hashesAll(numKeys);
+  std::vector<uint64_t> hashes64(numKeys);
+  std::vector<uint32_t> hashes128(numKeys);
+  for (int pattern = 0; pattern < 2; pattern++)
+  {
+    // random 64-bit keys, or multiples of 4096 (e.g. page numbers)
+    uint64_t random = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < numKeys; i++)
+      build[i] = pattern == 0 ? replayRandom(random) : uint64_t(i) * 4096;
+    for (size_t i = 0; i < numKeys; i++)
+      probe[i] = (i & 1) ? build[(i * 7919) % numKeys] : (pattern == 0 ? replayRandom(random) : uint64_t(numKeys + i) * 4096);
+    printf("%s keys: %u build, %u probe, %u slots\n", pattern == 0 ? "random" : "strided (i*4096)",
+           unsigned(numKeys), unsigned(numKeys), unsigned(capacity));
+
+    for (int method = 0; method < 3; method++)
+    {
+      static const char* Names[] = { "std::hash        ", "crc32cSlicingBy8 ", "crc32c_hash_u64  " };
+      JoinTable table;
+      table.keys.assign(capacity, 0);
+      table.payloads.assign(capacity, ~0u);
+      table.mask   = capacity - 1;
+      table.probes = 0;
+
+      double hashTime = 0, buildTime, probeTime;
+      size_t matches;
+      double startTime = wallSeconds();
+      if (method == 0)
+      {
+        std::hash<uint64_t> hasher;
+        for (size_t i = 0; i < numKeys; i++)
+          hashes64[i] = hasher(build[i]);
+        hashTime = wallSeconds() - startTime;
+        joinBuild(table, &build[0], &hashes64[0], numKeys);
+        buildTime = wallSeconds() - startTime;
+        startTime = wallSeconds();
+        for (size_t i = 0; i < numKeys; i++)
+          hashes64[i] = hasher(probe[i]);
+        hashTime += wallSeconds() - startTime;
+        matches = joinProbe(table, &probe[0], &hashes64[0], numKeys);
+      }
+      else
+      {
+        if (method == 1)
+          for (size_t i = 0; i < numKeys; i++)
+            hashes32[i] = crc32cSlicingBy8(&build[i], 8, 0);
+        else
+          crc32c_hash_u64(&build[0], numKeys, 0, &hashes32[0]);
+        hashTime = wallSeconds() - startTime;
+        joinBuild(table, &build[0], &hashes32[0], numKeys);
+        buildTime = wallSeconds() - startTime;
+        startTime = wallSeconds();
+        if (method == 1)
+          for (size_t i = 0; i < numKeys; i++)
+            hashes32[i] = crc32cSlicingBy8(&probe[i], 8, 0);
+        else
+          crc32c_hash_u64(&probe[0], numKeys, 0, &hashes32[0]);
+        hashTime += wallSeconds() - startTime;
+        matches = joinProbe(table, &probe[0], &hashes32[0], numKeys);
+      }
+      probeTime = wallSeconds() - startTime;
+
+      printf("  %s: hashing %5.2f ns/key, build %6.2f ns/key, probe %6.2f ns/key, %u matches, %.2f extra slots/key\n",
+             Names[method], hashTime * 1e9 / (2 * numKeys), buildTime * 1e9 / numKeys, probeTime * 1e9 / numKeys,
+             unsigned(matches), double(table.probes) / (2 * numKeys));
+    }
+  }
+
+  // raw column throughput of the bulk APIs
+  std::vector<uint32_t> column32(numKeys);
+  for (size_t i = 0; i < numKeys; i++)
+    column32[i] = uint32_t(build[i] * 2654435761u);
+  double startTime = wallSeconds();
+  crc32c_hash_u32(&column32[0], numKeys, 0, &hashes32u[0]);
+  double time32 = wallSeconds() - startTime;
+  startTime = wallSeconds();
+  crc32c_hash_u64(&build[0], numKeys, 0, &hashesAll[0]);
+  double time64 = wallSeconds() - startTime;
+  startTime = wallSeconds();
+  crc32c_hash_u128(&build[0], numKeys / 2, 0, &hashes128[0]);
+  double time128 = wallSeconds() - startTime;
+  printf("bulk hashing: u32 %.2f ns/key, u64 %.2f ns/key, 16 bytes %.2f ns/key\n",
+         time32 * 1e9 / numKeys, time64 * 1e9 / numKeys, time128 * 1e9 / (numKeys / 2));
+  return 0;
+}
+
+
+// //////////////////////////////////////////////////////////
+// parity blocks: CRC of an XOR of blocks derived from the blocks' CRCs
+
+/// "parity" mode: crc32_xor/crc32c_xor against hashing the XORed block directly for random block counts,
+/// lengths and previous CRCs (exit code 1 on any mismatch), then the cost of both on a stripe
+static int benchmarkParity(int argc, char** argv)
+{
+  size_t maxBlocks = 16, blockSize = 1 << 20;
+  unsigned rounds = 10000;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+      maxBlocks = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+      blockSize = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+      rounds = strtoul(argv[++i], NULL, 0);
+    else
+    {
+      printf("Usage: Crc32 parity [-n MAX_BLOCKS] [-s STRIPE_BLOCK_BYTES] [-r ROUNDS]\n");
+      return 1;
+    }
+  }
+  if (maxBlocks < 1)
+    maxBlocks = 1;
+  if (blockSize < 1)
+    blockSize = 1;
+
+  // random tests: up to maxBlocks blocks of up to 4 KB (including 0 blocks and empty blocks)
+  const size_t MaxTestLength = 4096;
+  std::vector<uint8_t> blocks(maxBlocks * MaxTestLength), parity(MaxTestLength);
+  std::vector<uint32_t> crcs(maxBlocks), crcsC(maxBlocks);
+  uint64_t random = 0x9E3779B97F4A7C15ULL;
+  for (size_t i = 0; i < blocks.size(); i++)
+    blocks[i] = uint8_t(replayRandom(random));
+
+  unsigned failures = 0;
+  for (unsigned round = 0; round < rounds; round++)
+  {
+    size_t   count    = size_t(replayRandom(random) % (maxBlocks + 1));
+    size_t   length   = size_t(replayRandom(random) % (MaxTestLength + 1));
+    uint32_t previous = (round & 1) ? uint32_t(replayRandom(random)) : 0;
+    if (round % 16 == 0)
+      length = round % 32; // short ones, too
+
+    memset(&parity[0], 0, length);
+    for (size_t block = 0; block < count; block++)
+    {
+      const uint8_t* current = &blocks[block * MaxTestLength];
+      for (size_t i = 0; i < length; i++)
+        parity[i] ^= current[i];
+      crcs [block] = crc32_fast (current, length, previous);
+      crcsC[block] = crc32c_fast(current, length, previous);
+    }
+
+    uint32_t expected  = crc32_fast (&parity[0], length, previous);
+    uint32_t expectedC = crc32c_fast(&parity[0], length, previous);
+    uint32_t derived   = crc32_xor (count ? &crcs [0] : NULL, count, length, previous);
+    uint32_t derivedC  = crc32c_xor(count ? &crcsC[0] : NULL, count, length, previous);
+    if (derived != expected || derivedC != expectedC)
+    {
+      if (failures++ < 10)
+        printf("MISMATCH: %u blocks of %u bytes, previous CRC %08X: CRC32 %08X vs %08X, CRC32C %08X vs %08X\n",
+               unsigned(count), unsigned(length), previous, derived, expected, derivedC, expectedC);
+    }
+  }
+  printf("%u random parity blocks (0..%u blocks of 0..%u bytes), CRC32 and CRC32C: %s\n",
+         rounds, unsigned(maxBlocks), unsigned(MaxTestLength), failures ? "FAILED" : "OK");
+
+  // one stripe: rehashing the parity block vs deriving its CRC
+  std::vector<uint8_t> stripe(maxBlocks * blockSize), stripeParity(blockSize);
+  for (size_t i = 0; i < stripe.size(); i++)
+    stripe[i] = uint8_t(replayRandom(random));
+  for (size_t block = 0; block < maxBlocks; block++)
+  {
+    const uint8_t* current = &stripe[block * blockSize];
+    for (size_t i = 0; i < blockSize; i++)
+      stripeParity[i] ^= current[i];
+    crcs [block] = crc32_fast (current, blockSize);
+    crcsC[block] = crc32c_fast(current, blockSize);
+  }
+  for (int castagnoli = 0; castagnoli < 2; castagnoli++)
+  {
+    const int Repeats = 16;
+    uint32_t hashed = 0, derived = 0;
+    double startTime = wallSeconds();
+    for (int repeat = 0; repeat < Repeats; repeat++)
+      hashed = (castagnoli ? crc32c_fast : crc32_fast)(&stripeParity[0], blockSize, 0);
+    double hashTime = (wallSeconds() - startTime) / Repeats;
+    startTime = wallSeconds();
+    for (int repeat = 0; repeat < Repeats; repeat++)
+      derived = castagnoli ? crc32c_xor(&crcsC[0], maxBlocks, blockSize) : crc32_xor(&crcs[0], maxBlocks, blockSize);
+    double deriveTime = (wallSeconds() - startTime) / Repeats;
+    if (hashed != derived)
+      failures++;
+    printf("%-6s parity of %u x %u bytes: hashing %9.1f us, derived %7.3f us, CRC=%08X %s\n",
+           castagnoli ? "CRC32C" : "CRC32", unsigned(maxBlocks), unsigned(blockSize),
+           hashTime * 1e6, deriveTime * 1e6, derived, hashed == derived ? "OK" : "MISMATCH");
+  }
+  return failures ? 1 : 0;
+}
+
+
+// //////////////////////////////////////////////////////////
+// checksum service: small-job latency next to bulk scrubs
+
+/// one small job of a client, filled in by the completion callback
+struct ServiceSlot
+{
+  double   submitted, completed;
+  uint32_t crc;
+  std::atomic<bool> done;
+};
+
+/// "service" mode: clients submit small jobs (a few at a time) while a scrubber keeps bulk jobs in flight;
+/// small-job latency percentiles with priority classes vs one FIFO for all jobs
+static int benchmarkService(const char* data, int argc, char** argv)
+{
+  unsigned numThreads = std::thread::hardware_concurrency();
+  unsigned numClients = 4, depth = 4;
+  size_t   smallBytes = 1024, numJobs = 20000, bulkBytes = 64*1024*1024;
+  for (int i = 0; i < argc; i++)
+  {
+    if      (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      numThreads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-c") == 0 && i+1 < argc)
+      numClients = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-q") == 0 && i+1 < argc)
+      depth      = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+      smallBytes = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+      numJobs    = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-b") == 0 && i+1 < argc)
+      bulkBytes  = strtoul(argv[++i], NULL, 0) * 1024*1024;
+    else
+    {
+      printf("Usage: Crc32 service [-t THREADS] [-c CLIENTS] [-q JOBS_IN_FLIGHT_PER_CLIENT] [-s SMALL_BYTES] [-n JOBS_PER_CLIENT] [-b BULK_MB]\n");
+      return 1;
+    }
+  }
+  if (numThreads < 1) numThreads = 1;
+  if (numClients < 1) numClients = 1;
+  if (depth      < 1) depth      = 1;
+  if (numJobs    < depth) numJobs = depth;
+  if (smallBytes > NumBytes / 2) smallBytes = NumBytes / 2;
+  if (bulkBytes  > NumBytes)     bulkBytes  = NumBytes;
+
+  const uint32_t bulkCrc = crc32_fast(data, bulkBytes, 0);
+  printf("%u workers, %u clients with %u jobs of %u bytes in flight each, bulk jobs of %u MB\n",
+         numThreads, numClients, depth, unsigned(smallBytes), unsigned(bulkBytes >> 20));
+
+  bool ok = true;
+  struct Scenario { const char* name; bool priorities; bool scrub; };
+  static const Scenario Scenarios[] =
+  {
+    { "priorities, no scrub  ", true,  false },
+    { "priorities, scrubbing ", true,  true  },
+    { "single FIFO, scrubbing", false, true  },
+  };
+  for (size_t s = 0; s < sizeof(Scenarios) / sizeof(Scenarios[0]); s++)
+  {
+    const Scenario& scenario = Scenarios[s];
+    Crc32Service service(numThreads, crc32_fast, crc32_combine, scenario.priorities);
+
+    // scrubber: one bulk job after another
+    std::atomic<bool> stop(false);
+    size_t scrubbed = 0, badBulk = 0;
+    std::thread scrubber([&]
+    {
+      while (scenario.scrub && !stop)
+      {
+        if (service.submit(data, bulkBytes, Crc32Service::Bulk).get() != bulkCrc)
+          badBulk++;
+        scrubbed += bulkBytes;
+      }
+    });
+    // give the scrubber a head start so that its pieces are queued
+    if (scenario.scrub)
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    std::vector<std::vector<ServiceSlot> > slots(numClients);
+    for (unsigned c = 0; c < numClients; c++)
+      slots[c] = std::vector<ServiceSlot>(numJobs);
+    double startTime = wallSeconds();
+    std::vector<std::thread> clients;
+    for (unsigned c = 0; c < numClients; c++)
+      clients.push_back(std::thread([&, c]
+      {
+        std::vector<ServiceSlot>& mine = slots[c];
+        for (size_t first = 0; first < numJobs; first += depth)
+        {
+          size_t last = std::min(first + depth, numJobs);
+          for (size_t j = first; j < last; j++)
+          {
+            ServiceSlot* slot = &mine[j];
+            slot->done      = false;
+            slot->submitted = wallSeconds();
+            service.submit(data + ((c * numJobs + j) * 4096) % (NumBytes - smallBytes), smallBytes,
+                           [slot](uint32_t crc) { slot->crc = crc; slot->completed = wallSeconds(); slot->done = true; });
+          }
+          for (size_t j = first; j < last; j++)
+            while (!mine[j].done)
+              std::this_thread::yield();
+        }
+      }));
+    for (unsigned c = 0; c < numClients; c++)
+      clients[c].join();
+    double duration = wallSeconds() - startTime;
+    stop = true;
+    scrubber.join();
+
+    std::vector<double> latencies;
+    size_t badSmall = 0;
+    for (unsigned c = 0; c < numClients; c++)
+      for (size_t j = 0; j < numJobs; j++)
+      {
+        const ServiceSlot& slot = slots[c][j];
+        latencies.push_back((slot.completed - slot.submitted) * 1e6);
+        if (slot.crc != crc32_fast(data + ((c * numJobs + j) * 4096) % (NumBytes - smallBytes), smallBytes, 0))
+          badSmall++;
+      }
+    std::sort(latencies.begin(), latencies.end());
+    size_t last = latencies.size() - 1;
+    printf("%s: small jobs us p50 %.1f p99 %.1f p99.9 %.1f max %.1f, %.0f jobs/s, bulk %.1f MB/s, %s\n",
+           scenario.name, latencies[last / 2], latencies[last * 99 / 100], latencies[last * 999 / 1000], latencies[last],
+           latencies.size() / duration, scrubbed / duration / (1024*1024),
+           (badSmall || badBulk) ? "CRC MISMATCH" : "CRCs ok");
+    if (badSmall || badBulk)
+      ok = false;
+  }
+  return ok ? 0 : 1;
+}
+
+
+// //////////////////////////////////////////////////////////
+// hardware performance counters (Linux perf_event_open)
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/// a counter to open
+struct PerfEvent
+{
+  const char* name;
+  uint32_t    type;
+  uint64_t    config;
+};
+
+const int MaxPerfEvents = 16;
+
+/// generic events; per-port uop counts are model-specific, pass them as raw events (-e)
+static const PerfEvent GenericPerfEvents[] =
+{
+  { "cycles",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES   },
+  { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "L1D loads",    PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16) },
+  { "L1D misses",   PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS   << 16) },
+};
+
+/// counters scheduled together; the first one that opened is the group leader
+struct PerfGroup
+{
+  int         fds  [MaxPerfEvents];
+  const char* names[MaxPerfEvents];
+  int         count;
+};
+
+static int perfOpen(const PerfEvent& event, int groupFd)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = event.type;
+  attr.config         = event.config;
+  attr.disabled       = (groupFd == -1);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int) syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+/// open as many events as the kernel/CPU allows, false if none
+static bool perfGroupOpen(PerfGroup& group, const PerfEvent* events, int numEvents)
+{
+  group.count = 0;
+  for (int i = 0; i < numEvents && group.count < MaxPerfEvents; i++)
+  {
+    int fd = perfOpen(events[i], group.count ? group.fds[0] : -1);
+    if (fd < 0)
+    {
+      printf("perf: %s not available (%s)\n", events[i].name, strerror(errno));
+      continue;
+    }
+    group.fds  [group.count] = fd;
+    group.names[group.count] = events[i].name;
+    group.count++;
+  }
+  return group.count > 0;
+}
+
+static void perfGroupClose(PerfGroup& group)
+{
+  for (int i = 0; i < group.count; i++)
+    close(group.fds[i]);
+  group.count = 0;
+}
+
+static void perfGroupStart(PerfGroup& group)
+{
+  ioctl(group.fds[0], PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+  ioctl(group.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/// stop counting and fetch the values, scaled up if the group was multiplexed
+static void perfGroupStop(PerfGroup& group, double* values)
+{
+  ioctl(group.fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  uint64_t buffer[3 + MaxPerfEvents];
+  memset(buffer, 0, sizeof(buffer));
+  if (read(group.fds[0], buffer, sizeof(buffer)) < 0)
+    buffer[0] = 0;
+  double scale = (buffer[2] > 0) ? double(buffer[1]) / buffer[2] : 0;
+  for (int i = 0; i < group.count; i++)
+    values[i] = (uint64_t(i) < buffer[0]) ? buffer[3 + i] * scale : 0;
+}
+
+/// index of a counter in the group, -1 if it didn't open
+static int perfFind(const PerfGroup& group, const char* name)
+{
+  for (int i = 0; i < group.count; i++)
+    if (strcmp(group.names[i], name) == 0)
+      return i;
+  return -1;
+}
+
+/// "perf" mode: cycles/byte, IPC, L1D misses (and any raw events given with -e name=0xCONFIG) per kernel,
+/// -k restricts it to kernels whose name contains a string (e.g. -k "16 bytes" compares the table layouts)
+static int benchmarkPerf(const char* data, int argc, char** argv)
+{
+  PerfEvent events[MaxPerfEvents];
+  int numEvents = 0;
+  for (int i = 0; i < int(sizeof(GenericPerfEvents) / sizeof(GenericPerfEvents[0])); i++)
+    events[numEvents++] = GenericPerfEvents[i];
+
+  size_t numBytes = NumBytes;
+  const char* only = "";
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+    {
+      numBytes = strtoull(argv[++i], NULL, 0);
+      if (numBytes == 0 || numBytes > NumBytes)
+        numBytes = NumBytes;
+    }
+    else if (strcmp(argv[i], "-k") == 0 && i+1 < argc)
+      only = argv[++i];
+    else if (strcmp(argv[i], "-e") == 0 && i+1 < argc && numEvents < MaxPerfEvents)
+    {
+      // e.g. Skylake UOPS_DISPATCHED_PORT.PORT_0: -e port0=0x01a1
+      char* spec  = argv[++i];
+      char* equal = strchr(spec, '=');
+      if (!equal)
+      {
+        printf("perf: expected -e name=0xCONFIG, got %s\n", spec);
+        return 1;
+      }
+      *equal = 0;
+      PerfEvent raw = { spec, PERF_TYPE_RAW, strtoull(equal + 1, NULL, 0) };
+      events[numEvents++] = raw;
+    }
+    else
+    {
+      printf("Usage: Crc32 perf [-s BYTES] [-k KERNEL_NAME_PART] [-e NAME=0xRAWCONFIG]...\n");
+      return 1;
+    }
+  }
+
+  PerfGroup group;
+  bool havePerf = perfGroupOpen(group, events, numEvents);
+  if (!havePerf)
+    printf("perf events not permitted or not supported (see /proc/sys/kernel/perf_event_paranoid),\n"
+           "reporting TSC reference cycles instead of core cycles\n");
+
+  int cycles       = havePerf ? perfFind(group, "cycles")       : -1;
+  int instructions = havePerf ? perfFind(group, "instructions") : -1;
+  int l1dLoads     = havePerf ? perfFind(group, "L1D loads")    : -1;
+  int l1dMisses    = havePerf ? perfFind(group, "L1D misses")   : -1;
+
+  for (int k = 0; k < NumKernels; k++)
+  {
+    if (Kernels[k].slow && numBytes > 16*1024*1024)
+      continue;
+    if (!strstr(Kernels[k].name, only))
+      continue;
+    double values[MaxPerfEvents];
+    if (havePerf)
+      perfGroupStart(group);
+    double   startTime  = seconds();
+    uint64_t startTicks = ticks();
+    uint32_t crc = Kernels[k].function(data, numBytes, 0);
+    uint64_t tscCycles = ticks() - startTicks;
+    double   duration  = seconds() - startTime;
+    if (havePerf)
+      perfGroupStop(group, values);
+
+    printf("%s: CRC=%08X, %.3fs, %.3f MB/s", Kernels[k].name, crc, duration, (numBytes / (1024*1024)) / duration);
+    if (cycles >= 0)
+      printf(", %.3f cycles/byte", values[cycles] / numBytes);
+    else if (tscCycles)
+      printf(", %.3f TSC cycles/byte", double(tscCycles) / numBytes);
+    if (cycles >= 0 && instructions >= 0 && values[cycles] > 0)
+      printf(", IPC %.2f", values[instructions] / values[cycles]);
+    if (l1dMisses >= 0)
+      printf(", L1D misses %.4f/byte", values[l1dMisses] / numBytes);
+    if (l1dMisses >= 0 && l1dLoads >= 0 && values[l1dLoads] > 0)
+      printf(" (%.2f%% of loads)", 100 * values[l1dMisses] / values[l1dLoads]);
+    for (int e = 0; e < group.count && havePerf; e++)
+      if (e != cycles && e != instructions && e != l1dLoads && e != l1dMisses)
+        printf(", %s %.3f/byte", group.names[e], values[e] / numBytes);
+    printf("\n");
+  }
+
+  if (havePerf)
+    perfGroupClose(group);
   return 0;
 }
+#endif // __linux__
+
+
+int main(int argc, char** argv)
+{
+  const char* mode = argc > 1 ? argv[1] : "";
+
+  printf("Please wait ...\n");
+  init();
+
+  // catch broken kernels before spending time on benchmarks
+  if (!checkCrc32() || !checkCrc32c())
+    return 1;
+#ifdef CRC32_TABLE_LAYOUTS
+  printf("huge-page tables: %s\n", Crc32HugeTablesKind);
+#endif
+#ifdef __linux__
+  // allocates its own buffer
+  if (strcmp(mode, "numa") == 0)
+    return benchmarkNuma(argc - 2, argv + 2);
+#endif
+  if (strcmp(mode, "scaling") == 0)
+    return benchmarkScaling(argc - 2, argv + 2);
+  if (strcmp(mode, "hash") == 0)
+    return benchmarkHash(argc - 2, argv + 2);
+  if (strcmp(mode, "parity") == 0)
+    return benchmarkParity(argc - 2, argv + 2);
+
+  // initialize
+  char* data = new char[NumBytes];
+  for (size_t i = 0; i < NumBytes; i++)
+    data[i] = char(i & 0xFF);
+
+  int result = 0;
+  if (*mode == 0)
+  {
+    benchmarkThroughput(data);
+    benchmarkBlocks(data);
+  }
+  else if (strcmp(mode, "cold") == 0 || strcmp(mode, "pressure") == 0)
+    result = benchmarkLatency(data, strcmp(mode, "cold") == 0, argc - 2, argv + 2);
+  else if (strcmp(mode, "short") == 0)
+    result = benchmarkShort(data, argc - 2, argv + 2);
+  else if (strcmp(mode, "l1") == 0)
+    result = benchmarkL1(data, argc - 2, argv + 2);
+  else if (strcmp(mode, "prefetch") == 0)
+    result = benchmarkPrefetch(data, argc - 2, argv + 2);
+  else if (strcmp(mode, "replay") == 0)
+    result = benchmarkReplay(data, argc - 2, argv + 2);
+  else if (strcmp(mode, "record") == 0)
+    result = benchmarkRecord(data, argc - 2, argv + 2);
+  else if (strcmp(mode, "compare") == 0)
+    result = benchmarkCompare(data, argc - 2, argv + 2);
+  else if (strcmp(mode, "service") == 0)
+    result = benchmarkService(data, argc - 2, argv + 2);
+#ifdef __linux__
+  else if (strcmp(mode, "perf") == 0)
+    result = benchmarkPerf(data, argc - 2, argv + 2);
+#endif
+  else
+  {
+    printf("Usage: Crc32 [MODE [OPTIONS]]\n"
+           "  (no mode)   throughput of all kernels on a 1 GB buffer\n"
+           "  cold        first-call latency per kernel and size with evicted lookup tables\n"
+           "  pressure    latency per kernel and size next to a cache-polluting co-workload\n"
+           "  short       ns per call for every size from 1 to 256 bytes with cold tables, PCLMUL vs slicing-by-16\n"
+           "  l1          slowdown of an application with an L1-sized working set caused by each kernel\n"
+           "  prefetch    software-prefetching kernels: MB/s and cache pollution per prefetch distance\n"
+#ifdef __linux__
+           "  numa        crc32_parallel on a buffer with a chosen NUMA policy and page size\n"
+#endif
+           "  scaling     aggregate and per-thread GB/s for 1..N threads, shared vs per-thread tables\n"
+           "  replay      a trace or distribution of call sizes: ns/call percentiles and MB/s per configuration\n"
+           "  hash        hash-join build/probe with std::hash vs bulk CRC32C column hashing\n"
+           "  parity      CRC of XORed blocks derived from their CRCs: random self-check and cost vs rehashing\n"
+           "  service     Crc32Service: small-job latency percentiles next to bulk scrubs, priorities vs one FIFO\n"
+           "  record      median ns and cycles/byte per kernel, size and alignment as JSON or CSV\n"
+           "  compare     same, checked against a stored baseline: exit code 1 on significant slowdowns\n"
+#ifdef __linux__
+           "  perf        same with hardware counters: cycles/byte, IPC, L1D misses, raw events\n"
+#endif
+          );
+    result = 1;
+  }
+
+#ifdef CRC32_STATS
+  crc32_stats_dump(stdout);
+#endif
+
+  delete[] data;
+  return result;
+}
+#endif // CRC32_NO_BENCHMARK
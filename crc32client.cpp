@@ -0,0 +1,236 @@
+// //////////////////////////////////////////////////////////
+// crc32client.cpp
+// client side of crc32d (see crc32d.cpp): data lives in memfd buffers shared with the daemon,
+// requests carry only (buffer, offset, length) over a UNIX seqpacket socket, nothing is copied.
+// Doesn't need Crc32.cpp: no tables, threads or tuning state in the client process.
+
+// #include "crc32client.cpp" (Linux, glibc 2.27+ for memfd_create)
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/// default socket of the daemon
+static const char* const Crc32dDefaultSocket = "/tmp/crc32d.sock";
+
+/// wire format (host byte order, both ends are on the same machine)
+const uint32_t Crc32dVersion = 1;
+
+enum Crc32dOperation
+{
+  Crc32dRegister   = 1, // fd attached: map a sealed memfd, reply.value = buffer id
+  Crc32dUnregister = 2, // forget buffer
+  Crc32dChecksum   = 3, // CRC of [offset, offset+length) of a registered buffer
+  Crc32dChecksumFd = 4  // fd attached: same for a one-time descriptor, mapped only for this request
+};
+
+/// request flags
+const uint32_t Crc32dCastagnoli = 1; // CRC32C instead of CRC32
+
+struct Crc32dRequest
+{
+  uint32_t version;
+  uint32_t operation;
+  uint32_t buffer;
+  uint32_t flags;
+  uint64_t offset;
+  uint64_t length;
+  uint32_t previousCrc32;
+  uint32_t tag;           // returned unchanged, replies to pipelined requests may arrive out of order
+};
+
+struct Crc32dReply
+{
+  uint32_t status;        // 0 or an errno value
+  uint32_t tag;
+  uint32_t crc;
+  uint32_t value;         // buffer id after Crc32dRegister
+};
+
+/// shared buffer: written by the client, read by the daemon
+struct Crc32dBuffer
+{
+  int      fd;
+  char*    data;
+  size_t   size;
+  uint32_t id;
+};
+
+
+/// send a request, optionally with a file descriptor
+inline bool crc32d_send_request(int connection, const Crc32dRequest& request, int fd = -1)
+{
+  struct iovec io;
+  io.iov_base = (void*) &request;
+  io.iov_len  = sizeof(request);
+
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov    = &io;
+  message.msg_iovlen = 1;
+
+  union { char buffer[CMSG_SPACE(sizeof(int))]; struct cmsghdr align; } control;
+  if (fd >= 0)
+  {
+    memset(&control, 0, sizeof(control));
+    message.msg_control    = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type  = SCM_RIGHTS;
+    header->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd, sizeof(int));
+  }
+
+  ssize_t sent;
+  while ((sent = sendmsg(connection, &message, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+    ;
+  return sent == ssize_t(sizeof(request));
+}
+
+/// wait for the next reply, false if the connection is broken
+inline bool crc32d_receive(int connection, Crc32dReply& reply)
+{
+  ssize_t got;
+  while ((got = recv(connection, &reply, sizeof(reply), 0)) < 0 && errno == EINTR)
+    ;
+  if (got != ssize_t(sizeof(reply)))
+  {
+    if (got >= 0)
+      errno = EPROTO;
+    return false;
+  }
+  return true;
+}
+
+/// send and wait for the reply (no other requests in flight), false and errno set on failure
+inline bool crc32d_call(int connection, const Crc32dRequest& request, Crc32dReply& reply, int fd = -1)
+{
+  if (!crc32d_send_request(connection, request, fd) || !crc32d_receive(connection, reply))
+    return false;
+  if (reply.status != 0)
+  {
+    errno = int(reply.status);
+    return false;
+  }
+  return true;
+}
+
+inline Crc32dRequest crc32d_request(uint32_t operation, uint32_t buffer, uint64_t offset, uint64_t length,
+                                    bool castagnoli, uint32_t previousCrc32, uint32_t tag)
+{
+  Crc32dRequest request;
+  request.version       = Crc32dVersion;
+  request.operation     = operation;
+  request.buffer        = buffer;
+  request.flags         = castagnoli ? Crc32dCastagnoli : 0;
+  request.offset        = offset;
+  request.length        = length;
+  request.previousCrc32 = previousCrc32;
+  request.tag           = tag;
+  return request;
+}
+
+
+/// connect to the daemon, -1 and errno set on failure
+inline int crc32d_connect(const char* path = Crc32dDefaultSocket)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  int connection = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (connection < 0)
+    return -1;
+  if (connect(connection, (struct sockaddr*) &address, sizeof(address)) != 0)
+  {
+    int error = errno;
+    close(connection);
+    errno = error;
+    return -1;
+  }
+  return connection;
+}
+
+/// create a memfd of size bytes, map it, seal its size (the daemon refuses buffers that may shrink under it)
+/// and register it with the daemon
+inline bool crc32d_alloc(int connection, size_t size, Crc32dBuffer& buffer)
+{
+  buffer.fd   = memfd_create("crc32d", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  buffer.data = NULL;
+  buffer.size = size;
+  buffer.id   = 0;
+  if (buffer.fd < 0)
+    return false;
+
+  Crc32dReply reply;
+  if (ftruncate(buffer.fd, off_t(size)) == 0 &&
+      fcntl(buffer.fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0 &&
+      (buffer.data = (char*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer.fd, 0)) != MAP_FAILED &&
+      crc32d_call(connection, crc32d_request(Crc32dRegister, 0, 0, size, false, 0, 0), reply, buffer.fd))
+  {
+    buffer.id = reply.value;
+    return true;
+  }
+
+  int error = errno;
+  if (buffer.data != NULL && buffer.data != MAP_FAILED)
+    munmap(buffer.data, size);
+  close(buffer.fd);
+  buffer.fd   = -1;
+  buffer.data = NULL;
+  errno = error;
+  return false;
+}
+
+/// unregister, unmap and close a buffer
+inline void crc32d_free(int connection, Crc32dBuffer& buffer)
+{
+  Crc32dReply reply;
+  crc32d_call(connection, crc32d_request(Crc32dUnregister, buffer.id, 0, 0, false, 0, 0), reply);
+  munmap(buffer.data, buffer.size);
+  close(buffer.fd);
+  buffer.fd   = -1;
+  buffer.data = NULL;
+}
+
+/// pipelined request: the reply with the same tag comes from crc32d_receive
+inline bool crc32d_send(int connection, const Crc32dBuffer& buffer, uint64_t offset, uint64_t length,
+                        bool castagnoli, uint32_t tag, uint32_t previousCrc32 = 0)
+{
+  return crc32d_send_request(connection, crc32d_request(Crc32dChecksum, buffer.id, offset, length, castagnoli, previousCrc32, tag));
+}
+
+/// CRC32 (or CRC32C) of buffer bytes [offset, offset+length), false and errno set on failure
+inline bool crc32d_checksum(int connection, const Crc32dBuffer& buffer, uint64_t offset, uint64_t length,
+                            bool castagnoli, uint32_t& crc, uint32_t previousCrc32 = 0)
+{
+  Crc32dReply reply;
+  if (!crc32d_call(connection, crc32d_request(Crc32dChecksum, buffer.id, offset, length, castagnoli, previousCrc32, 0), reply))
+    return false;
+  crc = reply.crc;
+  return true;
+}
+
+/// same for any memfd or file sealed against shrinking (F_SEAL_SHRINK), without registering it first
+inline bool crc32d_checksum_fd(int connection, int fd, uint64_t offset, uint64_t length,
+                               bool castagnoli, uint32_t& crc, uint32_t previousCrc32 = 0)
+{
+  Crc32dReply reply;
+  if (!crc32d_call(connection, crc32d_request(Crc32dChecksumFd, 0, offset, length, castagnoli, previousCrc32, 0), reply, fd))
+    return false;
+  crc = reply.crc;
+  return true;
+}
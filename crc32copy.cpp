@@ -0,0 +1,537 @@
+// //////////////////////////////////////////////////////////
+// crc32copy.cpp
+// file copy that produces the CRC32C of the written data:
+// reader, hasher and writer threads run concurrently on a fixed ring of aligned buffers,
+// connected by lock-free single-producer single-consumer queues (a stage sleeps only when its queue is empty or full)
+
+// g++ -o crc32copy crc32copy.cpp -O3 -march=native -mtune=native -pthread
+
+#define CRC32_NO_BENCHMARK
+#include "Crc32.cpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/// default ring: 8 buffers of 1 MB
+const unsigned DefaultNumBuffers = 8;
+const size_t   DefaultBufferSize = 1024*1024;
+/// buffers are aligned for O_DIRECT and to keep them off shared cache lines
+const size_t   BufferAlignment   = 4096;
+/// limits of -n and -b (KB)
+const long     MaxNumBuffers     = 1024;
+const long     MaxBufferKB       = 64*1024;
+/// marks the end of the stream in a queue
+const unsigned EndOfStream = ~0u;
+
+
+/// lock-free single-producer single-consumer queue of buffer indices
+class SpscQueue
+{
+public:
+  explicit SpscQueue(unsigned capacity) : slots(capacity + 1), head(0), tail(0) {}
+
+  /// producer side, false if full
+  bool push(unsigned value)
+  {
+    unsigned current = tail.load(std::memory_order_relaxed);
+    unsigned next    = (current + 1) % slots.size();
+    if (next == head.load())
+      return false;
+    slots[current] = value;
+    tail.store(next);
+    return true;
+  }
+
+  /// consumer side, false if empty
+  bool pop(unsigned& value)
+  {
+    unsigned current = head.load(std::memory_order_relaxed);
+    if (current == tail.load())
+      return false;
+    value = slots[current];
+    head.store((current + 1) % slots.size());
+    return true;
+  }
+
+private:
+  std::vector<unsigned> slots;
+  // producer and consumer indices live on separate cache lines;
+  // sequentially consistent so that Pipeline::wake() can't miss a stage that is about to sleep
+  alignas(64) std::atomic<unsigned> head;
+  alignas(64) std::atomic<unsigned> tail;
+};
+
+
+/// state shared by the three stages
+struct Pipeline
+{
+  int  source, destination;
+  std::vector<char*>  buffers;
+  std::vector<size_t> lengths;   // valid bytes per buffer, written before the index is pushed
+  SpscQueue free, filled, hashed;
+  std::atomic<int> error;        // first errno seen by any stage
+  uint32_t crc;                  // result of the hasher
+  uint64_t bytes;                // hashed (and handed to the writer) by the hasher
+  std::mutex              lock;  // only for sleeping on changed
+  std::condition_variable changed;
+  std::atomic<unsigned>   sleepers; // stages waiting on changed, wake() does nothing while it is 0
+
+  Pipeline(unsigned numBuffers)
+  : buffers(numBuffers), lengths(numBuffers), free(numBuffers), filled(numBuffers), hashed(numBuffers), error(0), crc(0), bytes(0), sleepers(0) {}
+
+  void fail(int code)
+  {
+    int expected = 0;
+    error.compare_exchange_strong(expected, code);
+    wake();
+  }
+
+  /// after a push or pop: a sleeper registers before its last check of its queue, all of it sequentially consistent,
+  /// so either it sees our update or we see it (then taking the lock makes sure it is already waiting)
+  void wake()
+  {
+    if (sleepers.load() == 0)
+      return;
+    { std::lock_guard<std::mutex> guard(lock); }
+    changed.notify_all();
+  }
+
+  /// sleeper side of wake(), called with lock held
+  void enterWait()
+  {
+    sleepers.fetch_add(1);
+  }
+  void leaveWait()
+  {
+    sleepers.fetch_sub(1);
+  }
+};
+
+/// wait until the queue accepts the value, false if another stage failed
+static bool pushWait(Pipeline& pipeline, SpscQueue& queue, unsigned value)
+{
+  if (!queue.push(value))
+  {
+    std::unique_lock<std::mutex> guard(pipeline.lock);
+    pipeline.enterWait();
+    while (!queue.push(value))
+    {
+      if (pipeline.error.load())
+      {
+        pipeline.leaveWait();
+        return false;
+      }
+      pipeline.changed.wait(guard);
+    }
+    pipeline.leaveWait();
+  }
+  pipeline.wake();
+  return true;
+}
+
+/// wait until a value arrives, false if another stage failed
+static bool popWait(Pipeline& pipeline, SpscQueue& queue, unsigned& value)
+{
+  if (!queue.pop(value))
+  {
+    std::unique_lock<std::mutex> guard(pipeline.lock);
+    pipeline.enterWait();
+    while (!queue.pop(value))
+    {
+      if (pipeline.error.load())
+      {
+        pipeline.leaveWait();
+        return false;
+      }
+      pipeline.changed.wait(guard);
+    }
+    pipeline.leaveWait();
+  }
+  pipeline.wake(); // a slot became free
+  return true;
+}
+
+
+static void readerStage(Pipeline& pipeline, size_t bufferSize)
+{
+  unsigned index;
+  while (popWait(pipeline, pipeline.free, index))
+  {
+    // fill the whole buffer unless we hit the end of file
+    size_t length = 0;
+    while (length < bufferSize)
+    {
+      ssize_t got = read(pipeline.source, pipeline.buffers[index] + length, bufferSize - length);
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got < 0)
+      {
+        pipeline.fail(errno);
+        return;
+      }
+      if (got == 0)
+        break;
+      length += got;
+    }
+
+    if (length > 0)
+    {
+      pipeline.lengths[index] = length;
+      if (!pushWait(pipeline, pipeline.filled, index))
+        return;
+    }
+    if (length < bufferSize)
+    {
+      pushWait(pipeline, pipeline.filled, EndOfStream);
+      return;
+    }
+  }
+}
+
+static void hasherStage(Pipeline& pipeline)
+{
+  uint32_t crc = 0;
+  uint64_t bytes = 0;
+  unsigned index;
+  while (popWait(pipeline, pipeline.filled, index))
+  {
+    if (index != EndOfStream)
+    {
+      crc = crc32c_16bytes(pipeline.buffers[index], pipeline.lengths[index], crc);
+      bytes += pipeline.lengths[index];
+    }
+    if (!pushWait(pipeline, pipeline.hashed, index))
+      return;
+    if (index == EndOfStream)
+      break;
+  }
+  pipeline.crc   = crc;
+  pipeline.bytes = bytes;
+}
+
+static void writerStage(Pipeline& pipeline)
+{
+  unsigned index;
+  while (popWait(pipeline, pipeline.hashed, index))
+  {
+    if (index == EndOfStream)
+      return;
+
+    const char* data   = pipeline.buffers[index];
+    size_t      length = pipeline.lengths[index];
+    while (length > 0)
+    {
+      ssize_t written = write(pipeline.destination, data, length);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written < 0)
+      {
+        pipeline.fail(errno);
+        return;
+      }
+      data += written, length -= written;
+    }
+    // recycle the buffer
+    if (!pushWait(pipeline, pipeline.free, index))
+      return;
+  }
+}
+
+
+/// copy source to destination, return errno-style result (EINVAL if both are the same file),
+/// crc = CRC32C of the copied data, bytes = how many were copied (the source may change size while it is read)
+int crc32Copy(const char* sourceName, const char* destinationName, uint32_t& crc, uint64_t& bytes,
+              unsigned numBuffers = DefaultNumBuffers, size_t bufferSize = DefaultBufferSize)
+{
+  Pipeline pipeline(numBuffers);
+  pipeline.source = open(sourceName, O_RDONLY);
+  if (pipeline.source < 0)
+    return errno;
+  struct stat info;
+  if (fstat(pipeline.source, &info) != 0)
+  {
+    int error = errno;
+    close(pipeline.source);
+    return error;
+  }
+  posix_fadvise(pipeline.source, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  // truncate only after making sure the destination isn't the source (or a hard link to it), like cp
+  pipeline.destination = open(destinationName, O_WRONLY | O_CREAT, info.st_mode & 0777);
+  if (pipeline.destination < 0)
+  {
+    int error = errno;
+    close(pipeline.source);
+    return error;
+  }
+  struct stat target;
+  int error = 0;
+  if (fstat(pipeline.destination, &target) != 0)
+    error = errno;
+  else if (target.st_dev == info.st_dev && target.st_ino == info.st_ino)
+    error = EINVAL;
+  else if (ftruncate(pipeline.destination, 0) != 0)
+    error = errno;
+  if (error)
+  {
+    close(pipeline.source);
+    close(pipeline.destination);
+    return error;
+  }
+
+  char* memory = NULL;
+  if (posix_memalign((void**) &memory, BufferAlignment, numBuffers * bufferSize) != 0)
+  {
+    close(pipeline.source);
+    close(pipeline.destination);
+    return ENOMEM;
+  }
+  for (unsigned i = 0; i < numBuffers; i++)
+  {
+    pipeline.buffers[i] = memory + i*bufferSize;
+    pipeline.free.push(i);
+  }
+
+  std::thread reader(readerStage, std::ref(pipeline), bufferSize);
+  std::thread hasher(hasherStage, std::ref(pipeline));
+  writerStage(pipeline);
+  reader.join();
+  hasher.join();
+
+  error = pipeline.error.load();
+  if (!error && fsync(pipeline.destination) != 0)
+    error = errno;
+  if (close(pipeline.destination) != 0 && !error)
+    error = errno;
+  close(pipeline.source);
+  free(memory);
+
+  crc   = pipeline.crc;
+  bytes = pipeline.bytes;
+  return error;
+}
+
+
+/// CRC32C of a file as stored on disk (page cache is dropped first), errno-style result
+static int crc32cFile(const char* name, uint32_t& crc)
+{
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return errno;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  std::vector<char> buffer(DefaultBufferSize);
+  int error = 0;
+  crc = 0;
+  for (;;)
+  {
+    ssize_t got = read(fd, &buffer[0], buffer.size());
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+    {
+      error = (got < 0 ? errno : 0);
+      break;
+    }
+    crc = crc32c_16bytes(&buffer[0], got, crc);
+  }
+  close(fd);
+  return error;
+}
+
+
+// //////////////////////////////////////////////////////////
+// benchmark
+
+static double seconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void dropCache(const char* name)
+{
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+/// run "cp source destination"
+static int runCp(const char* source, const char* destination)
+{
+  char* const args[] = { (char*) "cp", (char*) source, (char*) destination, NULL };
+  pid_t pid;
+  if (posix_spawnp(&pid, "cp", NULL, NULL, args, environ) != 0)
+    return -1;
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int benchmark(const char* source, const char* destination, unsigned numBuffers, size_t bufferSize)
+{
+  uint32_t crc;
+  uint64_t bytes;
+
+  dropCache(source);
+  double start = seconds();
+  int error = crc32Copy(source, destination, crc, bytes, numBuffers, bufferSize);
+  double duration = seconds() - start;
+  if (error)
+  {
+    fprintf(stderr, "crc32copy: %s\n", strerror(error));
+    return 1;
+  }
+  printf("pipelined copy   : CRC32C=%08X, %.3fs, %.3f MB/s\n", crc, duration, bytes / duration / 1e6);
+
+  unlink(destination);
+  dropCache(source);
+  start = seconds();
+  if (runCp(source, destination) != 0)
+  {
+    fprintf(stderr, "crc32copy: cp failed\n");
+    return 1;
+  }
+  // cp doesn't sync, do it for a fair comparison
+  int fd = open(destination, O_RDONLY);
+  if (fd >= 0)
+    fsync(fd), close(fd);
+  error = crc32cFile(destination, crc);
+  duration = seconds() - start;
+  if (error)
+  {
+    fprintf(stderr, "crc32copy: %s: %s\n", destination, strerror(error));
+    return 1;
+  }
+  printf("cp + checksum    : CRC32C=%08X, %.3fs, %.3f MB/s\n", crc, duration, bytes / duration / 1e6);
+  return 0;
+}
+
+
+/// numeric argument, 0 if it isn't a number between minimum and maximum
+static long parseNumber(const char* text, long minimum, long maximum)
+{
+  char* end;
+  errno = 0;
+  long value = strtol(text, &end, 10);
+  if (errno != 0 || end == text || *end != 0 || value < minimum || value > maximum)
+    return 0;
+  return value;
+}
+
+static void usage()
+{
+  printf("Usage: crc32copy [OPTION]... SOURCE DEST\n"
+         "Copy SOURCE to DEST and print the CRC32C of the copied data.\n"
+         "\n"
+         "  -v, --verify        re-read DEST from disk and compare its CRC32C\n"
+         "  -n, --buffers N     number of buffers in the ring (default %u)\n"
+         "  -b, --buffer KB     size of each buffer (default %zu)\n"
+         "      --bench         compare with cp followed by a separate checksum pass\n",
+         DefaultNumBuffers, DefaultBufferSize / 1024);
+}
+
+
+int main(int argc, char** argv)
+{
+  bool verify = false, bench = false;
+  unsigned numBuffers = DefaultNumBuffers;
+  size_t   bufferSize = DefaultBufferSize;
+  std::vector<const char*> names;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char* arg = argv[i];
+    if (strcmp(arg, "-v") == 0 || strcmp(arg, "--verify") == 0)
+      verify = true;
+    else if (strcmp(arg, "--bench") == 0)
+      bench = true;
+    else if ((strcmp(arg, "-n") == 0 || strcmp(arg, "--buffers") == 0) && i+1 < argc)
+    {
+      numBuffers = unsigned(parseNumber(argv[++i], 2, MaxNumBuffers));
+      if (numBuffers == 0)
+      {
+        fprintf(stderr, "crc32copy: invalid number of buffers '%s' (2..%ld)\n", argv[i], MaxNumBuffers);
+        usage();
+        return 1;
+      }
+    }
+    else if ((strcmp(arg, "-b") == 0 || strcmp(arg, "--buffer") == 0) && i+1 < argc)
+    {
+      bufferSize = size_t(parseNumber(argv[++i], 1, MaxBufferKB)) * 1024;
+      if (bufferSize == 0)
+      {
+        fprintf(stderr, "crc32copy: invalid buffer size '%s' (1..%ld KB)\n", argv[i], MaxBufferKB);
+        usage();
+        return 1;
+      }
+    }
+    else if (arg[0] == '-')
+    {
+      usage();
+      return strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0 ? 0 : 1;
+    }
+    else
+      names.push_back(arg);
+  }
+  if (names.size() != 2)
+  {
+    usage();
+    return 1;
+  }
+  bufferSize = (bufferSize + BufferAlignment - 1) / BufferAlignment * BufferAlignment;
+
+  init();
+
+  if (bench)
+    return benchmark(names[0], names[1], numBuffers, bufferSize);
+
+  uint32_t crc;
+  uint64_t bytes;
+  double start = seconds();
+  int error = crc32Copy(names[0], names[1], crc, bytes, numBuffers, bufferSize);
+  double duration = seconds() - start;
+  if (error)
+  {
+    fprintf(stderr, "crc32copy: %s -> %s: %s\n", names[0], names[1], strerror(error));
+    return 1;
+  }
+  printf("%08x  %s\n", crc, names[1]);
+  fprintf(stderr, "%llu bytes, %.3fs, %.3f MB/s\n", (unsigned long long) bytes, duration, bytes / duration / 1e6);
+
+  if (verify)
+  {
+    uint32_t stored;
+    error = crc32cFile(names[1], stored);
+    if (error)
+    {
+      fprintf(stderr, "crc32copy: %s: %s\n", names[1], strerror(error));
+      return 1;
+    }
+    if (stored != crc)
+    {
+      fprintf(stderr, "crc32copy: %s: verification FAILED (%08x on disk)\n", names[1], stored);
+      return 1;
+    }
+    fprintf(stderr, "%s: verified\n", names[1]);
+  }
+  return 0;
+}
@@ -0,0 +1,672 @@
+// //////////////////////////////////////////////////////////
+// crc32d.cpp
+// checksum offload daemon: processes on the same host send (memfd buffer, offset, length) over a UNIX socket
+// and get CRC32/CRC32C back, so one copy of the tables, threads and tuning serves all of them.
+// Buffers are registered once (fd passing) and mapped read-only, request data is never copied.
+// Small requests are hashed on the connection's thread, larger ones by a shared Crc32Service pool.
+// Only the connection's thread writes to its socket, without blocking: pool workers queue their replies and wake it,
+// so a client that doesn't read its replies stalls nobody but itself.
+// --bench is a load generator: requests/s and latency percentiles (starts a daemon in-process if none runs).
+
+// g++ -o crc32d crc32d.cpp -O3 -march=native -mtune=native -pthread
+
+#define CRC32_NO_BENCHMARK
+#include "Crc32.cpp"
+#include "crc32client.cpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/// requests up to that size are hashed right away (handing them to the pool costs a thread wakeup)
+const uint64_t InlineBytes = 64*1024;
+/// requests at least that large are scheduled as bulk work behind everything else
+const uint64_t BulkBytes   = 4*1024*1024;
+/// a client with that many replies owed (in the pool or unsent) has to read some before it may send more requests
+const size_t   MaxPendingReplies = 256;
+/// upper limit of -j
+const long     MaxThreads = 1024;
+/// upper limits of the --bench options -c, -q, -b and -n
+const long     MaxBenchClients  = 1024;
+const long     MaxBenchDepth    = 4096;
+const long     MaxBenchBytes    = 64*1024*1024;
+const long     MaxBenchRequests = 100000000;
+
+
+/// read-only mapping of (a part of) a client buffer, unmapped when the last request using it is done
+struct Mapping
+{
+  void*       base;
+  size_t      mapped;
+  const char* data;   // first byte of the client's range
+  uint64_t    size;
+
+  Mapping() : base(NULL), mapped(0), data(NULL), size(0) {}
+  ~Mapping()
+  {
+    if (base)
+      munmap(base, mapped);
+  }
+};
+
+/// one client; pool jobs keep it alive until their reply is queued
+struct Connection
+{
+  int        socket;
+  int        wakeup;      // eventfd, signaled by pool workers after queueing a reply
+  std::mutex outboxLock;
+  std::deque<Crc32dReply> outbox;  // replies not sent yet, only the connection thread sends them
+  size_t     inPool;      // requests handed to the pool whose reply isn't queued yet, guarded by outboxLock
+  std::map<uint32_t, std::shared_ptr<Mapping> > buffers; // only used by the connection thread
+  uint32_t   nextId;
+
+  explicit Connection(int socket) : socket(socket), wakeup(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)), inPool(0), nextId(1) {}
+  ~Connection()
+  {
+    close(socket);
+    if (wakeup >= 0)
+      close(wakeup);
+  }
+};
+
+/// shared by all connections
+static Crc32Service* service = NULL;
+
+
+static Crc32dReply makeReply(const Crc32dRequest& request, uint32_t status, uint32_t crc = 0, uint32_t value = 0)
+{
+  Crc32dReply reply;
+  reply.status = status;
+  reply.tag    = request.tag;
+  reply.crc    = crc;
+  reply.value  = value;
+  return reply;
+}
+
+/// reply from the connection thread, sent by the next flushReplies
+static void sendReply(Connection& connection, const Crc32dRequest& request, uint32_t status, uint32_t crc = 0, uint32_t value = 0)
+{
+  std::lock_guard<std::mutex> guard(connection.outboxLock);
+  connection.outbox.push_back(makeReply(request, status, crc, value));
+}
+
+/// reply from a pool worker: queue it and wake the connection thread, never touch the socket
+static void queuePoolReply(Connection& connection, const Crc32dRequest& request, uint32_t crc)
+{
+  {
+    std::lock_guard<std::mutex> guard(connection.outboxLock);
+    connection.outbox.push_back(makeReply(request, 0, crc));
+    connection.inPool--;
+  }
+  uint64_t one = 1;
+  if (write(connection.wakeup, &one, sizeof(one)) < 0) {} // only fails if the counter is already huge: still awake
+}
+
+/// send queued replies until the socket would block, false if the client went away
+static bool flushReplies(Connection& connection)
+{
+  for (;;)
+  {
+    Crc32dReply reply;
+    {
+      std::lock_guard<std::mutex> guard(connection.outboxLock);
+      if (connection.outbox.empty())
+        return true;
+      reply = connection.outbox.front();
+    }
+    ssize_t sent = send(connection.socket, &reply, sizeof(reply), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    std::lock_guard<std::mutex> guard(connection.outboxLock);
+    connection.outbox.pop_front();
+  }
+}
+
+/// map bytes [offset, offset+length) of a descriptor, returns 0 or an errno value;
+/// only descriptors sealed against shrinking are accepted, a truncated file would crash the daemon with SIGBUS
+static uint32_t mapDescriptor(int fd, uint64_t offset, uint64_t length, std::shared_ptr<Mapping>& mapping)
+{
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+    return errno;
+  int seals = fcntl(fd, F_GET_SEALS);
+  if (seals < 0 || !(seals & F_SEAL_SHRINK))
+    return EPERM;
+  if (offset > uint64_t(info.st_size) || length > uint64_t(info.st_size) - offset)
+    return ERANGE;
+
+  mapping = std::make_shared<Mapping>();
+  mapping->size = length;
+  if (length == 0)
+    return 0;
+
+  uint64_t start = offset & ~uint64_t(sysconf(_SC_PAGESIZE) - 1);
+  mapping->mapped = size_t(offset + length - start);
+  void* base = mmap(NULL, mapping->mapped, PROT_READ, MAP_SHARED, fd, off_t(start));
+  if (base == MAP_FAILED)
+    return errno;
+  mapping->base = base;
+  mapping->data = (const char*) base + (offset - start);
+  return 0;
+}
+
+/// hash a range of a mapping and send the reply
+static void checksum(const std::shared_ptr<Connection>& connection, const std::shared_ptr<Mapping>& mapping,
+                     uint64_t offset, const Crc32dRequest& request)
+{
+  bool castagnoli = (request.flags & Crc32dCastagnoli) != 0;
+  const char* data = mapping->data + offset;
+  if (request.length <= InlineBytes)
+  {
+    uint32_t crc = (castagnoli ? crc32c_fast : crc32_fast)(data, size_t(request.length), request.previousCrc32);
+    sendReply(*connection, request, 0, crc);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(connection->outboxLock);
+    connection->inPool++;
+  }
+  std::shared_ptr<Connection> owner = connection;
+  std::shared_ptr<Mapping>    keep  = mapping;
+  service->submit(data, size_t(request.length),
+                  [owner, keep, request](uint32_t crc) { queuePoolReply(*owner, request, crc); },
+                  request.length >= BulkBytes ? Crc32Service::Bulk : Crc32Service::Interactive, request.previousCrc32,
+                  castagnoli ? crc32c_fast : crc32_fast, castagnoli ? crc32c_combine : crc32_combine);
+}
+
+/// process the requests of one client until it disconnects
+static void serve(std::shared_ptr<Connection> connection)
+{
+  if (connection->wakeup < 0)
+  {
+    perror("crc32d: eventfd");
+    return;
+  }
+  bool readable = true; // poll only after the socket ran out of requests
+  for (;;)
+  {
+    if (!flushReplies(*connection))
+      break;
+
+    // wait for a request (unless too many replies are owed), for room in the socket, or for pool replies
+    bool owing, unsent;
+    {
+      std::lock_guard<std::mutex> guard(connection->outboxLock);
+      owing  = connection->outbox.size() + connection->inPool >= MaxPendingReplies;
+      unsent = !connection->outbox.empty();
+    }
+    if (owing || !readable)
+    {
+      struct pollfd events[2];
+      events[0].fd     = connection->socket;
+      events[0].events = short((owing ? 0 : POLLIN) | (unsent ? POLLOUT : 0));
+      events[1].fd     = connection->wakeup;
+      events[1].events = POLLIN;
+      if (poll(events, 2, -1) < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        break;
+      }
+      if (events[1].revents & POLLIN)
+      {
+        uint64_t count;
+        if (read(connection->wakeup, &count, sizeof(count)) < 0) {} // only resets the counter
+      }
+      if (!(events[0].revents & POLLIN))
+      {
+        if (events[0].revents & (POLLHUP | POLLERR))
+          break;
+        continue;
+      }
+      readable = true;
+    }
+
+    Crc32dRequest request;
+    struct iovec io;
+    io.iov_base = &request;
+    io.iov_len  = sizeof(request);
+    union { char buffer[CMSG_SPACE(sizeof(int))]; struct cmsghdr align; } control;
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov        = &io;
+    message.msg_iovlen     = 1;
+    message.msg_control    = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    ssize_t got = recvmsg(connection->socket, &message, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      readable = false;
+      continue;
+    }
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      break;
+
+    int fd = -1;
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+      if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+        memcpy(&fd, CMSG_DATA(header), sizeof(int));
+
+    if (got != ssize_t(sizeof(request)) || request.version != Crc32dVersion || (message.msg_flags & MSG_CTRUNC))
+    {
+      if (got == ssize_t(sizeof(request)))
+        sendReply(*connection, request, EPROTO);
+      if (fd >= 0)
+        close(fd);
+      continue;
+    }
+
+    switch (request.operation)
+    {
+    case Crc32dRegister:
+    {
+      std::shared_ptr<Mapping> mapping;
+      uint32_t status = fd < 0 ? EBADF : mapDescriptor(fd, 0, request.length, mapping);
+      uint32_t id = 0;
+      if (status == 0)
+      {
+        id = connection->nextId++;
+        connection->buffers[id] = mapping;
+      }
+      sendReply(*connection, request, status, 0, id);
+      break;
+    }
+
+    case Crc32dUnregister:
+      // requests in flight keep their mapping
+      sendReply(*connection, request, connection->buffers.erase(request.buffer) ? 0 : EBADF);
+      break;
+
+    case Crc32dChecksum:
+    {
+      std::map<uint32_t, std::shared_ptr<Mapping> >::const_iterator i = connection->buffers.find(request.buffer);
+      if (i == connection->buffers.end())
+        sendReply(*connection, request, EBADF);
+      else if (request.offset > i->second->size || request.length > i->second->size - request.offset)
+        sendReply(*connection, request, ERANGE);
+      else
+        checksum(connection, i->second, request.offset, request);
+      break;
+    }
+
+    case Crc32dChecksumFd:
+    {
+      std::shared_ptr<Mapping> mapping;
+      uint32_t status = fd < 0 ? EBADF : mapDescriptor(fd, request.offset, request.length, mapping);
+      if (status == 0)
+        checksum(connection, mapping, 0, request);
+      else
+        sendReply(*connection, request, status);
+      break;
+    }
+
+    default:
+      sendReply(*connection, request, EINVAL);
+    }
+
+    // mappings don't need the descriptor anymore
+    if (fd >= 0)
+      close(fd);
+  }
+}
+
+/// bind the socket (replacing a stale one), -1 on error
+static int listenOn(const char* path)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (listener < 0)
+    return -1;
+  unlink(path);
+  if (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 128) != 0)
+  {
+    int error = errno;
+    close(listener);
+    errno = error;
+    return -1;
+  }
+  return listener;
+}
+
+/// one thread per client
+static void acceptLoop(int listener)
+{
+  for (;;)
+  {
+    int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+    if (client < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE)
+        continue;
+      perror("crc32d: accept");
+      return;
+    }
+    std::thread(serve, std::make_shared<Connection>(client)).detach();
+  }
+}
+
+
+// //////////////////////////////////////////////////////////
+// load generator
+
+static double wallSeconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+struct BenchOptions
+{
+  unsigned clients;     // connections, like separate processes
+  unsigned depth;       // requests in flight per client
+  size_t   bytes;       // per request
+  size_t   requests;    // per client
+  bool     castagnoli;
+  bool     passFd;      // one-time descriptor per request instead of a registered buffer
+
+  BenchOptions() : clients(8), depth(4), bytes(4096), requests(20000), castagnoli(false), passFd(false) {}
+};
+
+/// the requests of one client, latencies in microseconds
+static bool benchClient(const char* path, const BenchOptions& options, std::vector<double>& latencies)
+{
+  // distinct ranges of the shared buffer, so that each request has its own bytes
+  const unsigned Ranges = 16;
+  int connection = crc32d_connect(path);
+  if (connection < 0)
+  {
+    perror("crc32d: connect");
+    return false;
+  }
+  Crc32dBuffer buffer;
+  if (!crc32d_alloc(connection, options.bytes * Ranges, buffer))
+  {
+    perror("crc32d: shared buffer");
+    close(connection);
+    return false;
+  }
+  for (size_t i = 0; i < buffer.size; i++)
+    buffer.data[i] = char(i * 7 + i / 4093);
+  uint32_t expected[Ranges];
+  for (unsigned r = 0; r < Ranges; r++)
+    expected[r] = (options.castagnoli ? crc32c_fast : crc32_fast)(buffer.data + r * options.bytes, options.bytes, 0);
+
+  latencies.resize(options.requests);
+  std::vector<double> sent(options.requests);
+  bool ok = true;
+  if (options.passFd)
+  {
+    for (size_t i = 0; i < options.requests && ok; i++)
+    {
+      uint32_t crc;
+      sent[i] = wallSeconds();
+      ok = crc32d_checksum_fd(connection, buffer.fd, (i % Ranges) * options.bytes, options.bytes, options.castagnoli, crc) &&
+           crc == expected[i % Ranges];
+      latencies[i] = (wallSeconds() - sent[i]) * 1e6;
+    }
+  }
+  else
+  {
+    // keep depth requests in flight, the tag is the request number
+    size_t next = 0, done = 0;
+    while (done < options.requests && ok)
+    {
+      while (next < options.requests && next - done < options.depth && ok)
+      {
+        sent[next] = wallSeconds();
+        ok = crc32d_send(connection, buffer, (next % Ranges) * options.bytes, options.bytes, options.castagnoli, uint32_t(next));
+        next++;
+      }
+      Crc32dReply reply;
+      if (!ok || !crc32d_receive(connection, reply) || reply.status != 0 || reply.tag >= next ||
+          reply.crc != expected[reply.tag % Ranges])
+      {
+        ok = false;
+        break;
+      }
+      latencies[reply.tag] = (wallSeconds() - sent[reply.tag]) * 1e6;
+      done++;
+    }
+  }
+  if (!ok)
+    fprintf(stderr, "crc32d: request failed or wrong CRC (%s)\n", strerror(errno));
+
+  crc32d_free(connection, buffer);
+  close(connection);
+  return ok;
+}
+
+static int benchmark(const char* path, const BenchOptions& options)
+{
+  // use a running daemon, otherwise start one in this process
+  int probe = crc32d_connect(path);
+  if (probe >= 0)
+  {
+    close(probe);
+    printf("using the daemon at %s\n", path);
+  }
+  else
+  {
+    int listener = listenOn(path);
+    if (listener < 0)
+    {
+      fprintf(stderr, "crc32d: %s: %s\n", path, strerror(errno));
+      return 1;
+    }
+    service = new Crc32Service();
+    std::thread(acceptLoop, listener).detach();
+    printf("started a daemon at %s with %u threads\n", path, service->numThreads());
+  }
+
+  // what a client pays without the daemon
+  std::vector<char> local(options.bytes, 1);
+  const int LocalCalls = 1000;
+  double startTime = wallSeconds();
+  uint32_t sink = 0;
+  for (int i = 0; i < LocalCalls; i++)
+    sink ^= (options.castagnoli ? crc32c_fast : crc32_fast)(&local[0], options.bytes, sink);
+  double localTime = (wallSeconds() - startTime) / LocalCalls;
+
+  std::vector<std::vector<double> > latencies(options.clients);
+  std::vector<char> ok(options.clients, 0);
+  std::vector<std::thread> clients;
+  startTime = wallSeconds();
+  for (unsigned c = 0; c < options.clients; c++)
+    clients.push_back(std::thread([&, c] { ok[c] = benchClient(path, options, latencies[c]); }));
+  for (unsigned c = 0; c < options.clients; c++)
+    clients[c].join();
+  double duration = wallSeconds() - startTime;
+
+  std::vector<double> all;
+  for (unsigned c = 0; c < options.clients; c++)
+  {
+    if (!ok[c])
+      return 1;
+    all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+  }
+  std::sort(all.begin(), all.end());
+  size_t last = all.size() - 1;
+  printf("%u clients x %u in flight, %u-byte %s requests (%s): %.0f requests/s, %.1f MB/s\n",
+         options.clients, options.passFd ? 1 : options.depth, unsigned(options.bytes), options.castagnoli ? "CRC32C" : "CRC32",
+         options.passFd ? "fd per request" : "registered buffer",
+         all.size() / duration, all.size() * double(options.bytes) / duration / (1024*1024));
+  printf("latency us: p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f (local %s: %.2f us per call, CRC %08X)\n",
+         all[last / 2], all[last * 90 / 100], all[last * 99 / 100], all[last * 999 / 1000], all[last],
+         options.castagnoli ? "crc32c_fast" : "crc32_fast", localTime * 1e6, sink);
+  return 0;
+}
+
+
+/// numeric argument, 0 if it isn't a number between minimum and maximum
+static long parseNumber(const char* text, long minimum, long maximum)
+{
+  char* end;
+  errno = 0;
+  long value = strtol(text, &end, 10);
+  if (errno != 0 || end == text || *end != 0 || value < minimum || value > maximum)
+    return 0;
+  return value;
+}
+
+/// -j argument, 0 if it isn't a number between 1 and MaxThreads
+static unsigned parseThreads(const char* text)
+{
+  return unsigned(parseNumber(text, 1, MaxThreads));
+}
+
+/// --bench argument, 0 (and a message) if it isn't a number between 1 and maximum
+static long parseBenchOption(const char* text, const char* what, long maximum)
+{
+  long value = parseNumber(text, 1, maximum);
+  if (value == 0)
+    fprintf(stderr, "crc32d: invalid %s '%s' (1..%ld)\n", what, text, maximum);
+  return value;
+}
+
+static void usage()
+{
+  printf("Usage: crc32d [OPTION]...\n"
+         "Serve CRC32/CRC32C requests for shared-memory buffers over a UNIX socket.\n"
+         "\n"
+         "  -s, --socket PATH   socket path (default %s)\n"
+         "  -j, --threads N     pool threads (default: all cores)\n"
+         "      --bench         load generator instead (starts a daemon in-process if none runs at PATH):\n"
+         "  -c CLIENTS          connections (default 8)\n"
+         "  -q DEPTH            requests in flight per connection (default 4)\n"
+         "  -b BYTES            bytes per request (default 4096)\n"
+         "  -n REQUESTS         requests per connection (default 20000)\n"
+         "  -C                  CRC32C instead of CRC32\n"
+         "  --fd                pass the memfd with every request instead of registering it once\n"
+         "  -h, --help          display this help and exit\n",
+         Crc32dDefaultSocket);
+}
+
+
+int main(int argc, char** argv)
+{
+  const char* path = Crc32dDefaultSocket;
+  unsigned numThreads = 0;
+  bool bench = false;
+  BenchOptions options;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char* arg = argv[i];
+    if ((strcmp(arg, "-s") == 0 || strcmp(arg, "--socket") == 0) && i+1 < argc)
+      path = argv[++i];
+    else if ((strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0) && i+1 < argc)
+    {
+      numThreads = parseThreads(argv[++i]);
+      if (numThreads == 0)
+      {
+        fprintf(stderr, "crc32d: invalid number of threads '%s'\n", argv[i]);
+        usage();
+        return 1;
+      }
+    }
+    else if (strcmp(arg, "--bench") == 0)
+      bench = true;
+    else if (strcmp(arg, "-c") == 0 && i+1 < argc)
+    {
+      options.clients = unsigned(parseBenchOption(argv[++i], "number of clients", MaxBenchClients));
+      if (options.clients == 0)
+      {
+        usage();
+        return 1;
+      }
+    }
+    else if (strcmp(arg, "-q") == 0 && i+1 < argc)
+    {
+      options.depth = unsigned(parseBenchOption(argv[++i], "queue depth", MaxBenchDepth));
+      if (options.depth == 0)
+      {
+        usage();
+        return 1;
+      }
+    }
+    else if (strcmp(arg, "-b") == 0 && i+1 < argc)
+    {
+      options.bytes = size_t(parseBenchOption(argv[++i], "request size", MaxBenchBytes));
+      if (options.bytes == 0)
+      {
+        usage();
+        return 1;
+      }
+    }
+    else if (strcmp(arg, "-n") == 0 && i+1 < argc)
+    {
+      options.requests = size_t(parseBenchOption(argv[++i], "number of requests", MaxBenchRequests));
+      if (options.requests == 0)
+      {
+        usage();
+        return 1;
+      }
+    }
+    else if (strcmp(arg, "-C") == 0)
+      options.castagnoli = true;
+    else if (strcmp(arg, "--fd") == 0)
+      options.passFd = true;
+    else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+    {
+      usage();
+      return 0;
+    }
+    else
+    {
+      fprintf(stderr, "crc32d: invalid option '%s'\nTry 'crc32d --help' for more information.\n", arg);
+      return 1;
+    }
+  }
+
+  init();
+  signal(SIGPIPE, SIG_IGN);
+  if (bench)
+    return benchmark(path, options);
+
+  int listener = listenOn(path);
+  if (listener < 0)
+  {
+    fprintf(stderr, "crc32d: %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  service = new Crc32Service(numThreads);
+  printf("crc32d: listening on %s, %u threads\n", path, service->numThreads());
+  fflush(stdout);
+  acceptLoop(listener);
+  return 1;
+}
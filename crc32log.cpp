@@ -0,0 +1,311 @@
+// //////////////////////////////////////////////////////////
+// crc32log.cpp
+// incremental verification of append-only logs: checkpoints (32-byte Crc32State records) are appended
+// to a sidecar file LOG.crc32state, so opening a log only hashes the bytes appended since the last one.
+// After a crash (log or sidecar torn), recover binary-searches for the last checkpoint that still matches.
+
+// g++ -o crc32log crc32log.cpp -O3 -march=native -mtune=native -pthread
+
+#define CRC32_NO_BENCHMARK
+#include "Crc32.cpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+
+/// pread() chunk size
+const size_t ReadBufferSize = 1024*1024;
+
+
+/// all valid checkpoints of a sidecar in file order; torn or damaged records are skipped
+static bool readCheckpoints(const std::string& sidecar, std::vector<Crc32State>& checkpoints)
+{
+  int fd = open(sidecar.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return errno == ENOENT; // no checkpoint yet
+  uint8_t record[Crc32StateSize];
+  for (off_t offset = 0; pread(fd, record, sizeof(record), offset) == ssize_t(sizeof(record)); offset += sizeof(record))
+  {
+    Crc32State state;
+    if (crc32_state_decode(record, state))
+      checkpoints.push_back(state);
+  }
+  close(fd);
+  return true;
+}
+
+/// append one checkpoint and make it durable
+static bool appendCheckpoint(const std::string& sidecar, const Crc32State& state)
+{
+  int fd = open(sidecar.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+  // a record torn by an earlier crash would shift all later ones: start at a record boundary
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size % Crc32StateSize != 0 &&
+      ftruncate(fd, info.st_size - info.st_size % Crc32StateSize) != 0)
+  {
+    close(fd);
+    return false;
+  }
+  uint8_t record[Crc32StateSize];
+  crc32_state_encode(state, record);
+  bool ok = write(fd, record, sizeof(record)) == ssize_t(sizeof(record)) && fdatasync(fd) == 0;
+  close(fd);
+  return ok;
+}
+
+/// replace the sidecar by the given checkpoints (atomically)
+static bool rewriteCheckpoints(const std::string& sidecar, const std::vector<Crc32State>& checkpoints)
+{
+  std::string temporary = sidecar + ".tmp";
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+  bool ok = true;
+  for (size_t i = 0; i < checkpoints.size() && ok; i++)
+  {
+    uint8_t record[Crc32StateSize];
+    crc32_state_encode(checkpoints[i], record);
+    ok = write(fd, record, sizeof(record)) == ssize_t(sizeof(record));
+  }
+  ok = ok && fsync(fd) == 0;
+  close(fd);
+  return ok && rename(temporary.c_str(), sidecar.c_str()) == 0;
+}
+
+/// continue state with the log bytes up to position end
+static bool hashUpTo(int fd, Crc32State& state, uint64_t end, std::vector<char>& buffer)
+{
+  while (state.length < end)
+  {
+    size_t want = end - state.length < buffer.size() ? size_t(end - state.length) : buffer.size();
+    ssize_t got = pread(fd, &buffer[0], want, off_t(state.length));
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+    {
+      if (got == 0)
+        errno = EIO; // file shrank
+      return false;
+    }
+    crc32_state_update(state, &buffer[0], size_t(got));
+  }
+  return true;
+}
+
+
+/// resume from the last checkpoint, hash what was appended since, store a new checkpoint
+static int checkpoint(const char* log, const std::string& sidecar, bool castagnoli)
+{
+  std::vector<Crc32State> checkpoints;
+  int fd = open(log, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0 || !readCheckpoints(sidecar, checkpoints))
+  {
+    fprintf(stderr, "crc32log: %s: %s\n", fd < 0 ? log : sidecar.c_str(), strerror(errno));
+    return 1;
+  }
+
+  Crc32State state;
+  crc32_state_init(state, castagnoli);
+  if (!checkpoints.empty())
+    state = checkpoints.back();
+  if (state.length > uint64_t(info.st_size))
+  {
+    fprintf(stderr, "crc32log: %s: log has %llu bytes but its last checkpoint covers %llu, run 'crc32log recover'\n",
+            log, (unsigned long long) info.st_size, (unsigned long long) state.length);
+    close(fd);
+    return 1;
+  }
+
+  uint64_t resumed = state.length;
+  std::vector<char> buffer(ReadBufferSize);
+  // the checkpoint must not cover bytes that a crash could still take away
+  if (!hashUpTo(fd, state, info.st_size, buffer) || fdatasync(fd) != 0 ||
+      (state.length > resumed && !appendCheckpoint(sidecar, state)))
+  {
+    fprintf(stderr, "crc32log: %s: %s\n", log, strerror(errno));
+    close(fd);
+    return 1;
+  }
+  close(fd);
+
+  printf("%08x  %s (%llu bytes, %llu new since the last checkpoint)\n", state.crc, log,
+         (unsigned long long) state.length, (unsigned long long) (state.length - resumed));
+  return 0;
+}
+
+/// hash the whole log and compare with every checkpoint
+static int verify(const char* log, const std::string& sidecar)
+{
+  std::vector<Crc32State> checkpoints;
+  int fd = open(log, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0 || !readCheckpoints(sidecar, checkpoints))
+  {
+    fprintf(stderr, "crc32log: %s: %s\n", fd < 0 ? log : sidecar.c_str(), strerror(errno));
+    return 1;
+  }
+  if (checkpoints.empty())
+  {
+    fprintf(stderr, "crc32log: %s: no checkpoints\n", sidecar.c_str());
+    close(fd);
+    return 1;
+  }
+
+  Crc32State state;
+  crc32_state_init(state, checkpoints[0].polynomial == Crc32StateCrc32C);
+  std::vector<char> buffer(ReadBufferSize);
+  for (size_t i = 0; i < checkpoints.size(); i++)
+  {
+    const Crc32State& expected = checkpoints[i];
+    if (expected.length > uint64_t(info.st_size) || expected.length < state.length ||
+        !hashUpTo(fd, state, expected.length, buffer) || state.crc != expected.crc)
+    {
+      printf("%s: FAILED at checkpoint %u of %u (%llu bytes)\n", log, unsigned(i + 1), unsigned(checkpoints.size()),
+             (unsigned long long) expected.length);
+      close(fd);
+      return 1;
+    }
+  }
+  close(fd);
+  printf("%s: OK, %u checkpoints, %llu of %llu bytes covered\n", log, unsigned(checkpoints.size()),
+         (unsigned long long) state.length, (unsigned long long) info.st_size);
+  return 0;
+}
+
+/// binary search for the last checkpoint that matches the log: if checkpoint k matches, so do all before it
+/// (the log is append-only), and each probe only hashes from the last known good checkpoint to the probed one
+static int recover(const char* log, const std::string& sidecar)
+{
+  std::vector<Crc32State> checkpoints;
+  int fd = open(log, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0 || !readCheckpoints(sidecar, checkpoints))
+  {
+    fprintf(stderr, "crc32log: %s: %s\n", fd < 0 ? log : sidecar.c_str(), strerror(errno));
+    return 1;
+  }
+
+  // checkpoints beyond the end of the log or out of order can't be right
+  std::vector<Crc32State> candidates;
+  for (size_t i = 0; i < checkpoints.size(); i++)
+    if (checkpoints[i].length <= uint64_t(info.st_size) && checkpoints[i].polynomial == checkpoints[0].polynomial &&
+        (candidates.empty() || checkpoints[i].length >= candidates.back().length))
+      candidates.push_back(checkpoints[i]);
+
+  Crc32State good;
+  crc32_state_init(good, !checkpoints.empty() && checkpoints[0].polynomial == Crc32StateCrc32C);
+  long long low = -1, high = (long long) candidates.size(); // low is known good (-1 = empty log), high is known bad
+  uint64_t hashed = 0;
+  std::vector<char> buffer(ReadBufferSize);
+  while (low + 1 < high)
+  {
+    long long middle = (low + high) / 2;
+    Crc32State probe = good;
+    if (!hashUpTo(fd, probe, candidates[middle].length, buffer))
+    {
+      fprintf(stderr, "crc32log: %s: %s\n", log, strerror(errno));
+      close(fd);
+      return 1;
+    }
+    hashed += probe.length - good.length;
+    if (probe.crc == candidates[middle].crc)
+      low = middle, good = probe;
+    else
+      high = middle;
+  }
+  close(fd);
+
+  candidates.resize(size_t(low + 1));
+  if (candidates.size() != checkpoints.size() && !rewriteCheckpoints(sidecar, candidates))
+  {
+    fprintf(stderr, "crc32log: %s: %s\n", sidecar.c_str(), strerror(errno));
+    return 1;
+  }
+  printf("%s: last valid checkpoint %u of %u at %llu bytes (CRC %08x), %llu bytes after it unverified, "
+         "%u checkpoints dropped, %llu bytes hashed\n",
+         log, unsigned(low + 1), unsigned(checkpoints.size()), (unsigned long long) good.length, good.crc,
+         (unsigned long long) (info.st_size - good.length), unsigned(checkpoints.size() - candidates.size()),
+         (unsigned long long) hashed);
+  return 0;
+}
+
+
+static void usage()
+{
+  printf("Usage: crc32log [OPTION]... COMMAND LOG...\n"
+         "Incrementally verify append-only logs with checkpoints in LOG.crc32state.\n"
+         "\n"
+         "  checkpoint        hash the bytes appended since the last checkpoint and add a new one\n"
+         "  verify            hash each log completely and compare with all its checkpoints\n"
+         "  recover           after a crash: binary search for the last checkpoint that matches the log\n"
+         "                    and drop the ones after it\n"
+         "\n"
+         "  -C, --crc32c      use the CRC32C (Castagnoli) polynomial for new sidecars\n"
+         "  -s, --sidecar F   checkpoint file (default LOG.crc32state, one LOG only)\n"
+         "  -h, --help        display this help and exit\n");
+}
+
+
+int main(int argc, char** argv)
+{
+  bool castagnoli = false;
+  const char* command = NULL;
+  const char* sidecar = NULL;
+  std::vector<const char*> logs;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char* arg = argv[i];
+    if (strcmp(arg, "-C") == 0 || strcmp(arg, "--crc32c") == 0)
+      castagnoli = true;
+    else if ((strcmp(arg, "-s") == 0 || strcmp(arg, "--sidecar") == 0) && i+1 < argc)
+      sidecar = argv[++i];
+    else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+    {
+      usage();
+      return 0;
+    }
+    else if (arg[0] == '-' && arg[1] != 0)
+    {
+      fprintf(stderr, "crc32log: invalid option '%s'\nTry 'crc32log --help' for more information.\n", arg);
+      return 1;
+    }
+    else if (!command)
+      command = arg;
+    else
+      logs.push_back(arg);
+  }
+  if (!command || logs.empty() || (sidecar && logs.size() > 1) ||
+      (strcmp(command, "checkpoint") != 0 && strcmp(command, "verify") != 0 && strcmp(command, "recover") != 0))
+  {
+    usage();
+    return 1;
+  }
+
+  init();
+  int exitCode = 0;
+  for (size_t i = 0; i < logs.size(); i++)
+  {
+    std::string sidecarName = sidecar ? sidecar : std::string(logs[i]) + ".crc32state";
+    int result;
+    if (strcmp(command, "checkpoint") == 0)
+      result = checkpoint(logs[i], sidecarName, castagnoli);
+    else if (strcmp(command, "verify") == 0)
+      result = verify(logs[i], sidecarName);
+    else
+      result = recover(logs[i], sidecarName);
+    if (result != 0)
+      exitCode = result;
+  }
+  return exitCode;
+}
@@ -0,0 +1,640 @@
+// //////////////////////////////////////////////////////////
+// crc32pcap.cpp
+// Ethernet frame check sequence verification of pcap and pcapng captures.
+// The FCS is the zlib CRC32 of the frame, so the CRC32 of frame + FCS is always the residue 0x2144DF1C.
+// The main thread walks the record headers of the memory-mapped file and hands out batches of frames,
+// all threads hash them with crc32_messages (four frames in flight per thread).
+
+// g++ -o crc32pcap crc32pcap.cpp -O3 -march=native -mtune=native -pthread
+
+#define CRC32_NO_BENCHMARK
+#include "Crc32.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/// CRC32 of any frame followed by its correct FCS
+const uint32_t FcsResidue = 0x2144DF1C;
+
+/// frames per unit of work
+const size_t BatchFrames = 256;
+
+/// upper limit of -j
+const long MaxThreads = 1024;
+/// upper limit of -f, same range as the pcapng if_fcslen option
+const long MaxFcsLength = 255;
+
+/// link type of Ethernet in pcap and pcapng
+const uint32_t LinkTypeEthernet = 1;
+
+/// shortest frame with an FCS: destination, source, EtherType, FCS
+const uint32_t MinFrameLength = 6 + 6 + 2 + 4;
+
+
+/// readers for either byte order, the caller checks bounds
+static inline uint16_t get16(const uint8_t* p, bool swapped)
+{
+  return swapped ? uint16_t((p[0] << 8) | p[1]) : uint16_t(p[0] | (p[1] << 8));
+}
+static inline uint32_t get32(const uint8_t* p, bool swapped)
+{
+  return swapped ? (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+                 : p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+
+/// a frame with its FCS, located by the header walk
+struct Frame
+{
+  uint64_t number;   // 1-based, as in Wireshark
+  uint64_t offset;   // of the first byte in the file
+  uint32_t length;   // including the FCS
+};
+
+/// unit of work
+struct Batch
+{
+  std::vector<Frame>       frames;
+  std::vector<const void*> pointers;
+  std::vector<size_t>      lengths;
+  std::vector<uint32_t>    crcs;
+  std::vector<Frame>       bad;
+};
+
+/// a memory-mapped capture
+struct Capture
+{
+  std::string        name;
+  const uint8_t*     data;
+  uint64_t           size;
+  // results
+  uint64_t           frames, verified, bytes, truncated, skipped;
+  std::vector<Frame> bad;
+  std::string        error;    // capture can't be parsed (completely)
+
+  Capture() : data(NULL), size(0), frames(0), verified(0), bytes(0), truncated(0), skipped(0) {}
+};
+
+/// command line
+struct Options
+{
+  unsigned numThreads;
+  unsigned fcsLength;  // if the capture doesn't say
+  bool     lanes;      // crc32_messages instead of one crc32_fast per frame
+  bool     quiet;      // no line per bad frame
+
+  Options() : numThreads(std::thread::hardware_concurrency()), fcsLength(4), lanes(true), quiet(false) {}
+};
+
+
+// //////////////////////////////////////////////////////////
+// verification
+
+/// residue check of all frames of a batch
+static void verifyBatch(const Capture& capture, Batch& batch, bool lanes)
+{
+  size_t numFrames = batch.frames.size();
+  batch.pointers.resize(numFrames);
+  batch.lengths .resize(numFrames);
+  batch.crcs    .resize(numFrames);
+  for (size_t i = 0; i < numFrames; i++)
+  {
+    batch.pointers[i] = capture.data + batch.frames[i].offset;
+    batch.lengths [i] = batch.frames[i].length;
+  }
+
+  if (lanes)
+    crc32_messages(&batch.pointers[0], &batch.lengths[0], numFrames, &batch.crcs[0]);
+  else
+    for (size_t i = 0; i < numFrames; i++)
+      batch.crcs[i] = crc32_fast(batch.pointers[i], batch.lengths[i]);
+
+  for (size_t i = 0; i < numFrames; i++)
+    if (batch.crcs[i] != FcsResidue)
+      batch.bad.push_back(batch.frames[i]);
+}
+
+/// batches between the header walk and the verifying threads
+class Verifier
+{
+public:
+  Verifier(Capture& capture, const Options& options)
+  : capture(capture), lanes(options.lanes), finished(false), current(new Batch)
+  {
+    for (unsigned t = 1; t < options.numThreads; t++)
+      threads.push_back(std::thread(&Verifier::work, this));
+  }
+
+  ~Verifier()
+  {
+    finish();
+    delete current;
+  }
+
+  /// frame found by the header walk: check its size and FCS length, queue it
+  void add(uint64_t offset, uint32_t captured, uint32_t original, unsigned fcsLength)
+  {
+    capture.frames++;
+    if (captured < original)
+    {
+      capture.truncated++; // snap length cut off the FCS
+      return;
+    }
+    if (fcsLength != 4 || captured < MinFrameLength)
+    {
+      capture.skipped++;
+      return;
+    }
+    Frame frame = { capture.frames, offset, captured };
+    current->frames.push_back(frame);
+    capture.bytes += captured;
+    if (current->frames.size() == BatchFrames)
+      flush();
+  }
+
+  /// verify what's left, wait for all threads
+  void finish()
+  {
+    flush();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      finished = true;
+    }
+    ready.notify_all();
+    work(); // help with the rest
+    for (size_t i = 0; i < threads.size(); i++)
+      threads[i].join();
+    threads.clear();
+  }
+
+private:
+  void flush()
+  {
+    if (current->frames.empty())
+      return;
+    if (threads.empty())
+    {
+      // single-threaded: verify right away, no queue
+      verifyBatch(capture, *current, lanes);
+      collect(*current);
+      current->frames.clear();
+      current->bad.clear();
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      batches.push_back(current);
+    }
+    ready.notify_one();
+    current = new Batch;
+    current->frames.reserve(BatchFrames);
+  }
+
+  /// take batches until the header walk is done and the queue is empty
+  void work()
+  {
+    for (;;)
+    {
+      Batch* batch;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        while (batches.empty() && !finished)
+          ready.wait(guard);
+        if (batches.empty())
+          return;
+        batch = batches.front();
+        batches.pop_front();
+      }
+      verifyBatch(capture, *batch, lanes);
+      if (!batch->bad.empty())
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        collect(*batch);
+      }
+      delete batch;
+    }
+  }
+
+  void collect(const Batch& batch)
+  {
+    capture.bad.insert(capture.bad.end(), batch.bad.begin(), batch.bad.end());
+  }
+
+  Capture&                 capture;
+  bool                     lanes;
+  std::vector<std::thread> threads;
+  std::mutex               lock;
+  std::condition_variable  ready;
+  std::deque<Batch*>       batches;
+  bool                     finished;
+  Batch*                   current;  // filled by the header walk
+};
+
+
+// //////////////////////////////////////////////////////////
+// pcap: 24-byte file header, then a 16-byte header per record
+
+static void parsePcap(Capture& capture, Verifier& verifier, unsigned defaultFcsLength)
+{
+  const uint8_t* data = capture.data;
+  uint32_t magic = get32(data, false);
+  bool swapped = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+  if (capture.size < 24)
+  {
+    capture.error = "truncated pcap header";
+    return;
+  }
+
+  // link type field: FCS length in 16-bit words (bits 29..31) if bit 28 is set
+  uint32_t linkType = get32(data + 20, swapped);
+  unsigned fcsLength = (linkType & (1u << 28)) ? (linkType >> 29) * 2 : defaultFcsLength;
+  if ((linkType & 0xFFFF) != LinkTypeEthernet)
+  {
+    capture.error = "not an Ethernet capture (link type " + std::to_string(linkType & 0xFFFF) + ")";
+    return;
+  }
+
+  uint64_t offset = 24;
+  while (capture.size - offset >= 16)
+  {
+    uint32_t captured = get32(data + offset +  8, swapped);
+    uint32_t original = get32(data + offset + 12, swapped);
+    if (captured > capture.size - offset - 16)
+    {
+      capture.error = "truncated record at offset " + std::to_string(offset);
+      return;
+    }
+    verifier.add(offset + 16, captured, original, fcsLength);
+    offset += 16 + captured;
+  }
+  if (offset != capture.size)
+    capture.error = "truncated record header at offset " + std::to_string(offset);
+}
+
+
+// //////////////////////////////////////////////////////////
+// pcapng: blocks of (type, length, body, length), byte order set by each section header
+
+static void parsePcapng(Capture& capture, Verifier& verifier, unsigned defaultFcsLength)
+{
+  const uint32_t SectionHeader = 0x0A0D0D0A, InterfaceDescription = 1, Packet = 2, SimplePacket = 3, EnhancedPacket = 6;
+  const uint8_t* data = capture.data;
+
+  /// per interface of the current section: link type and FCS length
+  std::vector<uint32_t> linkTypes, fcsLengths;
+  bool swapped = false;
+  uint64_t offset = 0;
+  while (capture.size - offset >= 12)
+  {
+    const uint8_t* block = data + offset;
+    uint32_t type = get32(block, swapped);
+    if (type == SectionHeader)
+    {
+      uint32_t byteOrder = get32(block + 8, false);
+      if (byteOrder != 0x1A2B3C4D && byteOrder != 0x4D3C2B1A)
+      {
+        capture.error = "damaged section header at offset " + std::to_string(offset);
+        return;
+      }
+      swapped = byteOrder == 0x4D3C2B1A;
+      linkTypes.clear();
+      fcsLengths.clear();
+    }
+    uint32_t length = get32(block + 4, swapped);
+    if (length < 12 || length % 4 != 0 || length > capture.size - offset)
+    {
+      capture.error = "damaged block at offset " + std::to_string(offset);
+      return;
+    }
+    const uint8_t* body = block + 8;
+    uint32_t bodyLength = length - 12;
+
+    if (type == InterfaceDescription && bodyLength >= 8)
+    {
+      linkTypes .push_back(get16(body, swapped));
+      fcsLengths.push_back(defaultFcsLength);
+      // options: if_fcslen (13) has the FCS length in bytes
+      const uint8_t* option = body + 8;
+      const uint8_t* end    = body + bodyLength;
+      while (end - option >= 4)
+      {
+        uint16_t code = get16(option, swapped), optionLength = get16(option + 2, swapped);
+        if (code == 0 || end - option - 4 < optionLength)
+          break;
+        if (code == 13 && optionLength >= 1)
+          fcsLengths.back() = option[4];
+        option += 4 + ((optionLength + 3) & ~3);
+      }
+    }
+    else if (type == EnhancedPacket || type == Packet || type == SimplePacket)
+    {
+      uint32_t interface, captured, original, header;
+      if (type == SimplePacket && bodyLength >= 4)
+      {
+        interface = 0;
+        original  = get32(body, swapped);
+        captured  = std::min(original, bodyLength - 4);
+        header    = 4;
+      }
+      else if (type != SimplePacket && bodyLength >= 20)
+      {
+        interface = type == Packet ? get16(body, swapped) : get32(body, swapped);
+        captured  = get32(body + 12, swapped);
+        original  = get32(body + 16, swapped);
+        header    = 20;
+      }
+      else
+      {
+        capture.error = "damaged packet block at offset " + std::to_string(offset);
+        return;
+      }
+      if (interface >= linkTypes.size() || captured > bodyLength - header)
+      {
+        capture.error = "damaged packet block at offset " + std::to_string(offset);
+        return;
+      }
+      if (linkTypes[interface] == LinkTypeEthernet)
+        verifier.add(offset + 8 + header, captured, original, fcsLengths[interface]);
+      else
+      {
+        capture.frames++;
+        capture.skipped++;
+      }
+    }
+    offset += length;
+  }
+  if (offset != capture.size)
+    capture.error = "truncated block at offset " + std::to_string(offset);
+}
+
+
+// //////////////////////////////////////////////////////////
+// driver
+
+static double wallSeconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static bool openCapture(Capture& capture)
+{
+  int fd = open(capture.name.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    capture.error = strerror(errno);
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    capture.error = strerror(errno);
+    close(fd);
+    return false;
+  }
+  capture.size = info.st_size;
+  if (capture.size < 12)
+  {
+    close(fd);
+    capture.error = "too small for a capture";
+    return false;
+  }
+  void* mapped = mmap(NULL, capture.size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    capture.error = strerror(errno);
+    return false;
+  }
+  madvise(mapped, capture.size, MADV_SEQUENTIAL);
+  capture.data = (const uint8_t*) mapped;
+  return true;
+}
+
+/// walk the headers and verify all frames, returns seconds
+static double verifyCapture(Capture& capture, const Options& options)
+{
+  double start = wallSeconds();
+  {
+    Verifier verifier(capture, options);
+    uint32_t magic = get32(capture.data, false);
+    if (magic == 0x0A0D0D0A)
+      parsePcapng(capture, verifier, options.fcsLength);
+    else if (magic == 0xa1b2c3d4 || magic == 0xd4c3b2a1 || magic == 0xa1b23c4d || magic == 0x4d3cb2a1)
+      parsePcap(capture, verifier, options.fcsLength);
+    else
+      capture.error = "neither pcap nor pcapng";
+  }
+  double duration = wallSeconds() - start;
+
+  std::sort(capture.bad.begin(), capture.bad.end(), [](const Frame& a, const Frame& b) { return a.offset < b.offset; });
+  capture.verified = capture.frames - capture.truncated - capture.skipped - capture.bad.size();
+  return duration;
+}
+
+static void printResult(const Capture& capture, double duration, const Options& options)
+{
+  if (!options.quiet)
+    for (size_t i = 0; i < capture.bad.size(); i++)
+      printf("%s: frame %llu at offset %llu (%u bytes): bad FCS\n", capture.name.c_str(),
+             (unsigned long long) capture.bad[i].number, (unsigned long long) capture.bad[i].offset, capture.bad[i].length);
+  if (!capture.error.empty())
+    printf("%s: ERROR: %s\n", capture.name.c_str(), capture.error.c_str());
+  printf("%s: %llu frames, %llu OK, %zu bad FCS, %llu truncated, %llu skipped, %.3f s, %.2f Mframes/s, %.2f Gbit/s\n",
+         capture.name.c_str(), (unsigned long long) capture.frames, (unsigned long long) capture.verified,
+         capture.bad.size(), (unsigned long long) capture.truncated, (unsigned long long) capture.skipped,
+         duration, duration > 0 ? capture.frames / duration / 1e6 : 0, duration > 0 ? capture.bytes * 8 / duration / 1e9 : 0);
+}
+
+
+// //////////////////////////////////////////////////////////
+// benchmark
+
+/// little-endian writers
+static void put16(std::vector<uint8_t>& out, uint16_t value) { out.push_back(uint8_t(value)); out.push_back(uint8_t(value >> 8)); }
+static void put32(std::vector<uint8_t>& out, uint32_t value) { put16(out, uint16_t(value)); put16(out, uint16_t(value >> 16)); }
+
+/// an in-memory pcap of random frames (64..1518 bytes, mostly small or full-sized), every 1000th with a bad FCS,
+/// verified with crc32_messages and with one crc32_fast call per frame
+static int benchmark(size_t numFrames, Options options)
+{
+  std::vector<uint8_t> file;
+  put32(file, 0xa1b2c3d4);
+  put16(file, 2); put16(file, 4);
+  put32(file, 0); put32(file, 0);
+  put32(file, 65535);
+  put32(file, LinkTypeEthernet | (1u << 28) | (2u << 29)); // FCS: 2 words
+  uint64_t random = 0x2545F4914F6CDD1DULL, expectedBad = 0;
+  for (size_t i = 0; i < numFrames; i++)
+  {
+    random ^= random << 13; random ^= random >> 7; random ^= random << 17;
+    unsigned pick = unsigned(random % 100);
+    uint32_t length = pick < 50 ? 64 + unsigned(random >> 32) % 64 : pick < 80 ? 1518 : 64 + unsigned(random >> 32) % 1455;
+    put32(file, uint32_t(i)); put32(file, 0);
+    put32(file, length); put32(file, length);
+    size_t start = file.size();
+    for (uint32_t b = 0; b < length - 4; b++)
+      file.push_back(uint8_t((random >> (b % 57)) + b));
+    uint32_t fcs = crc32_fast(&file[start], length - 4);
+    if (i % 1000 == 999)
+    {
+      fcs ^= 1;
+      expectedBad++;
+    }
+    put32(file, fcs);
+  }
+  printf("%zu frames, %.1f MB, %llu with a bad FCS, %u threads\n",
+         numFrames, file.size() / 1e6, (unsigned long long) expectedBad, options.numThreads);
+
+  options.quiet = true;
+  int exitCode = 0;
+  for (int lanes = 1; lanes >= 0; lanes--)
+  {
+    options.lanes = lanes != 0;
+    const int Repeats = 5;
+    double best = 1e30;
+    Capture capture;
+    for (int repeat = 0; repeat < Repeats; repeat++)
+    {
+      capture = Capture();
+      capture.name = lanes ? "crc32_messages (4 lanes)" : "crc32_fast per frame    ";
+      capture.data = &file[0];
+      capture.size = file.size();
+      best = std::min(best, verifyCapture(capture, options));
+    }
+    printResult(capture, best, options);
+    if (capture.bad.size() != expectedBad || !capture.error.empty())
+      exitCode = 1;
+  }
+  return exitCode;
+}
+
+
+/// numeric argument, -1 if it isn't a number between minimum and maximum
+static long parseNumber(const char* text, long minimum, long maximum)
+{
+  char* end;
+  errno = 0;
+  long value = strtol(text, &end, 10);
+  if (errno != 0 || end == text || *end != 0 || value < minimum || value > maximum)
+    return -1;
+  return value;
+}
+
+/// -j argument, 0 if it isn't a number between 1 and MaxThreads
+static unsigned parseThreads(const char* text)
+{
+  long value = parseNumber(text, 1, MaxThreads);
+  return value < 0 ? 0 : unsigned(value);
+}
+
+static void usage()
+{
+  printf("Usage: crc32pcap [OPTION]... CAPTURE...\n"
+         "Verify the Ethernet FCS of every frame in pcap and pcapng files.\n"
+         "\n"
+         "  -j, --threads N     verification threads (default: all cores)\n"
+         "  -f, --fcs-length N  FCS bytes per frame if the capture doesn't say (default 4, 0 = none)\n"
+         "  -1, --single        one CRC call per frame instead of four frames in flight\n"
+         "  -q, --quiet         don't list bad frames, only the totals\n"
+         "  --bench [-n FRAMES] verify a generated capture with and without the multi-lane kernel\n"
+         "  -h, --help          display this help and exit\n"
+         "\n"
+         "Frames cut short by the snap length are reported as truncated; frames of other link types\n"
+         "or without FCS as skipped. Exit status is 1 if any FCS is bad or a capture is damaged.\n");
+}
+
+
+int main(int argc, char** argv)
+{
+  Options options;
+  bool bench = false;
+  size_t benchFrames = 2000000;
+  std::vector<Capture> captures;
+  for (int i = 1; i < argc; i++)
+  {
+    const char* arg = argv[i];
+    if ((strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0) && i+1 < argc)
+    {
+      options.numThreads = parseThreads(argv[++i]);
+      if (options.numThreads == 0)
+      {
+        fprintf(stderr, "crc32pcap: invalid number of threads '%s'\n", argv[i]);
+        usage();
+        return 1;
+      }
+    }
+    else if ((strcmp(arg, "-f") == 0 || strcmp(arg, "--fcs-length") == 0) && i+1 < argc)
+    {
+      long fcsLength = parseNumber(argv[++i], 0, MaxFcsLength);
+      if (fcsLength < 0)
+      {
+        fprintf(stderr, "crc32pcap: invalid FCS length '%s' (0..%ld)\n", argv[i], MaxFcsLength);
+        usage();
+        return 1;
+      }
+      options.fcsLength = unsigned(fcsLength);
+    }
+    else if (strcmp(arg, "-1") == 0 || strcmp(arg, "--single") == 0)
+      options.lanes = false;
+    else if (strcmp(arg, "-q") == 0 || strcmp(arg, "--quiet") == 0)
+      options.quiet = true;
+    else if (strcmp(arg, "--bench") == 0)
+      bench = true;
+    else if (strcmp(arg, "-n") == 0 && i+1 < argc)
+      benchFrames = strtoull(argv[++i], NULL, 0);
+    else if (arg[0] == '-')
+    {
+      usage();
+      return strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0 ? 0 : 1;
+    }
+    else
+    {
+      captures.push_back(Capture());
+      captures.back().name = arg;
+    }
+  }
+  if (options.numThreads < 1)
+    options.numThreads = 1;
+
+  init();
+  if (bench)
+    return benchmark(benchFrames, options);
+  if (captures.empty())
+  {
+    usage();
+    return 1;
+  }
+
+  int exitCode = 0;
+  for (size_t i = 0; i < captures.size(); i++)
+  {
+    Capture& capture = captures[i];
+    double duration = 0;
+    if (openCapture(capture))
+      duration = verifyCapture(capture, options);
+    printResult(capture, duration, options);
+    if (!capture.error.empty() || !capture.bad.empty())
+      exitCode = 1;
+    if (capture.data)
+      munmap((void*) capture.data, capture.size);
+  }
+  return exitCode;
+}
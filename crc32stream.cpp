@@ -0,0 +1,561 @@
+// //////////////////////////////////////////////////////////
+// crc32stream.cpp
+// file checksum engine for fast storage: io_uring with registered, aligned buffers and O_DIRECT,
+// several reads in flight while already completed buffers are CRC'ed by the Crc32.cpp kernels.
+// Falls back to plain pread() when io_uring (or O_DIRECT) isn't available.
+
+// g++ -o crc32stream crc32stream.cpp -O3 -march=native -mtune=native
+
+#define CRC32_NO_BENCHMARK
+#include "Crc32.cpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+
+/// O_DIRECT requires offsets, lengths and addresses aligned to the logical block size
+const size_t DirectAlignment = 4096;
+/// limits of -q (IORING_MAX_ENTRIES) and -b (KB)
+const long   MaxQueueDepth   = 32768;
+const long   MaxBufferKB     = 64*1024;
+
+/// engine settings
+struct StreamOptions
+{
+  unsigned queueDepth;  // reads in flight
+  size_t   bufferSize;  // bytes per read, multiple of DirectAlignment
+  bool     direct;      // bypass the page cache
+  bool     useUring;    // false = pread() fallback
+
+  StreamOptions() : queueDepth(8), bufferSize(1024*1024), direct(true), useUring(true) {}
+};
+
+
+// //////////////////////////////////////////////////////////
+// minimal io_uring wrapper (raw syscalls, no liburing needed)
+
+struct Uring
+{
+  int  fd;
+  // submission queue
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+  struct io_uring_sqe* sqes;
+  // completion queue
+  unsigned *cqHead, *cqTail, *cqMask;
+  struct io_uring_cqe* cqes;
+  // for munmap
+  void  *sqRing, *cqRing;
+  size_t sqRingSize, cqRingSize, sqesSize;
+};
+
+static bool uringOpen(Uring& ring, unsigned entries)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring.fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+  if (ring.fd < 0)
+    return false;
+
+  ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring.cqRingSize = params.cq_off.cqes  + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    ring.sqRingSize = ring.cqRingSize = (ring.sqRingSize > ring.cqRingSize ? ring.sqRingSize : ring.cqRingSize);
+  ring.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  ring.sqRing = mmap(NULL, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+  ring.cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring.sqRing :
+                mmap(NULL, ring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+  ring.sqes   = (struct io_uring_sqe*)
+                mmap(NULL, ring.sqesSize,   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+  if (ring.sqRing == MAP_FAILED || ring.cqRing == MAP_FAILED || ring.sqes == MAP_FAILED)
+  {
+    close(ring.fd);
+    return false;
+  }
+
+  char* sq = (char*) ring.sqRing;
+  char* cq = (char*) ring.cqRing;
+  ring.sqHead  = (unsigned*) (sq + params.sq_off.head);
+  ring.sqTail  = (unsigned*) (sq + params.sq_off.tail);
+  ring.sqMask  = (unsigned*) (sq + params.sq_off.ring_mask);
+  ring.sqArray = (unsigned*) (sq + params.sq_off.array);
+  ring.cqHead  = (unsigned*) (cq + params.cq_off.head);
+  ring.cqTail  = (unsigned*) (cq + params.cq_off.tail);
+  ring.cqMask  = (unsigned*) (cq + params.cq_off.ring_mask);
+  ring.cqes    = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+  return true;
+}
+
+static void uringClose(Uring& ring)
+{
+  munmap(ring.sqes, ring.sqesSize);
+  if (ring.cqRing != ring.sqRing)
+    munmap(ring.cqRing, ring.cqRingSize);
+  munmap(ring.sqRing, ring.sqRingSize);
+  close(ring.fd);
+}
+
+/// queue a READ_FIXED of a registered buffer (submitted by the next uringEnter)
+static void uringQueueRead(Uring& ring, int fd, void* buffer, unsigned length, uint64_t offset, unsigned bufferIndex)
+{
+  unsigned tail  = *ring.sqTail;
+  unsigned index = tail & *ring.sqMask;
+  struct io_uring_sqe* sqe = &ring.sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode    = IORING_OP_READ_FIXED;
+  sqe->fd        = fd;
+  sqe->off       = offset;
+  sqe->addr      = (uint64_t) (uintptr_t) buffer;
+  sqe->len       = length;
+  sqe->buf_index = (uint16_t) bufferIndex;
+  sqe->user_data = bufferIndex;
+  ring.sqArray[index] = index;
+  __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int uringEnter(Uring& ring, unsigned toSubmit, unsigned minComplete)
+{
+  return (int) syscall(__NR_io_uring_enter, ring.fd, toSubmit, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/// fetch one completion, false if none is ready
+static bool uringPeek(Uring& ring, uint64_t& userData, int& result)
+{
+  unsigned head = *ring.cqHead;
+  if (head == __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE))
+    return false;
+  struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+  userData = cqe->user_data;
+  result   = cqe->res;
+  __atomic_store_n(ring.cqHead, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+// //////////////////////////////////////////////////////////
+// engine
+
+/// aligned buffers, registered with the ring if possible
+static char* allocateBuffers(const StreamOptions& options)
+{
+  void* memory = NULL;
+  if (posix_memalign(&memory, DirectAlignment, options.queueDepth * options.bufferSize) != 0)
+    return NULL;
+  return (char*) memory;
+}
+
+/// read the file with pread() (fallback path), errno-style result
+static int crc32FilePread(int fd, uint64_t size, Crc32Function crcFunction, uint32_t& crc,
+                          char* buffer, size_t bufferSize)
+{
+  crc = 0;
+  for (uint64_t offset = 0; offset < size; )
+  {
+    ssize_t got = pread(fd, buffer, bufferSize, offset);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got < 0)
+      return errno;
+    if (got == 0)
+      return EIO; // file shrunk while reading
+    if (uint64_t(got) > size - offset)
+      got = size - offset;
+    // short read in the middle of the file: continue at an aligned offset (O_DIRECT), the partial block is read again
+    else if (uint64_t(got) < size - offset && size_t(got) >= DirectAlignment)
+      got &= ~ssize_t(DirectAlignment - 1);
+    crc = crcFunction(buffer, got, crc);
+    offset += got;
+  }
+  return 0;
+}
+
+/// io_uring path: keep queueDepth reads in flight, CRC the buffers strictly in file order;
+/// busy = reads may still target the buffers (the ring couldn't be drained), so they must not be freed
+static int crc32FileUring(Uring& ring, int fd, uint64_t size, Crc32Function crcFunction, uint32_t& crc,
+                          char* buffers, const StreamOptions& options, bool& busy)
+{
+  const unsigned depth = options.queueDepth;
+  const size_t   bufferSize = options.bufferSize;
+  const uint64_t numBlocks  = (size + bufferSize - 1) / bufferSize;
+
+  // block i is read into buffer (i % depth)
+  int*     results = new int[depth];
+  bool*    done    = new bool[depth];
+  uint64_t nextToSubmit = 0, nextToHash = 0;
+  unsigned queued = 0, inFlight = 0;
+  int      error  = 0;
+
+  crc = 0;
+  while (nextToHash < numBlocks && !error)
+  {
+    // refill all free buffers
+    while (nextToSubmit < numBlocks && nextToSubmit < nextToHash + depth)
+    {
+      unsigned slot = unsigned(nextToSubmit % depth);
+      done[slot] = false;
+      uringQueueRead(ring, fd, buffers + slot*bufferSize, unsigned(bufferSize), nextToSubmit*bufferSize, slot);
+      nextToSubmit++, queued++, inFlight++;
+    }
+
+    // wait until the next block in file order has arrived
+    unsigned slot = unsigned(nextToHash % depth);
+    while (!done[slot])
+    {
+      int submitted = uringEnter(ring, queued, 1);
+      if (submitted < 0 && errno != EINTR)
+      {
+        error = errno;
+        break;
+      }
+      if (submitted > 0)
+        queued -= submitted;
+      uint64_t userData;
+      int      result;
+      while (uringPeek(ring, userData, result))
+        done[userData] = true, results[userData] = result, inFlight--;
+    }
+    if (error)
+      break;
+
+    uint64_t offset   = nextToHash*bufferSize;
+    size_t   expected = (size - offset < bufferSize) ? size_t(size - offset) : bufferSize;
+    char*    buffer   = buffers + slot*bufferSize;
+    if (results[slot] < 0)
+    {
+      error = -results[slot];
+      break;
+    }
+    // short read in the middle of the file: finish it synchronously,
+    // O_DIRECT needs an aligned offset and length, so the partial last block is read again
+    size_t got = results[slot];
+    while (got < expected)
+    {
+      size_t  aligned = got & ~(DirectAlignment - 1);
+      ssize_t more = pread(fd, buffer + aligned, bufferSize - aligned, offset + aligned);
+      if (more < 0 && errno == EINTR)
+        continue;
+      if (more <= 0 || aligned + more <= got)
+      {
+        error = (more < 0 ? errno : EIO);
+        break;
+      }
+      got = aligned + more;
+    }
+    if (error)
+      break;
+
+    crc = crcFunction(buffer, expected, crc);
+    nextToHash++;
+  }
+
+  // don't leave reads targeting our buffers behind
+  while (inFlight > 0)
+  {
+    uint64_t userData;
+    int      result;
+    int submitted = uringEnter(ring, queued, 1);
+    if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      break;
+    if (submitted > 0)
+      queued -= submitted;
+    while (uringPeek(ring, userData, result))
+      inFlight--;
+  }
+  busy = (inFlight > 0);
+
+  delete[] done;
+  delete[] results;
+  return error;
+}
+
+
+/// statistics of one crc32File call
+struct StreamStats
+{
+  bool usedUring, usedDirect;
+};
+
+/// compute the CRC of a whole file, errno-style result (0 = success)
+int crc32File(const char* name, Crc32Function crcFunction, uint32_t& crc,
+              const StreamOptions& options = StreamOptions(), StreamStats* stats = NULL)
+{
+  StreamStats dummy;
+  if (!stats)
+    stats = &dummy;
+  stats->usedUring = stats->usedDirect = false;
+
+  int fd = -1;
+  if (options.direct)
+    fd = open(name, O_RDONLY | O_DIRECT);
+  stats->usedDirect = (fd >= 0);
+  if (fd < 0)
+    fd = open(name, O_RDONLY); // e.g. tmpfs doesn't support O_DIRECT
+  if (fd < 0)
+    return errno;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    int error = errno;
+    close(fd);
+    return error;
+  }
+  if (!stats->usedDirect)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  char* buffers = allocateBuffers(options);
+  if (!buffers)
+  {
+    close(fd);
+    return ENOMEM;
+  }
+
+  int  error = 0;
+  bool busy  = false;
+  Uring ring;
+  if (options.useUring && uringOpen(ring, options.queueDepth))
+  {
+    struct iovec* iovecs = new struct iovec[options.queueDepth];
+    for (unsigned i = 0; i < options.queueDepth; i++)
+      iovecs[i].iov_base = buffers + i*options.bufferSize, iovecs[i].iov_len = options.bufferSize;
+    // registration pins the buffers once instead of on every read
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, iovecs, options.queueDepth) == 0)
+    {
+      stats->usedUring = true;
+      error = crc32FileUring(ring, fd, info.st_size, crcFunction, crc, buffers, options, busy);
+    }
+    delete[] iovecs;
+    uringClose(ring);
+  }
+  if (!stats->usedUring)
+    error = crc32FilePread(fd, info.st_size, crcFunction, crc, buffers, options.bufferSize);
+
+  // the kernel may still write into buffers of reads we couldn't reap: leak them rather than reuse the memory
+  if (!busy)
+    free(buffers);
+  close(fd);
+  return error;
+}
+
+
+// //////////////////////////////////////////////////////////
+// benchmark
+
+static double wallSeconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double cpuSeconds()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/// evict the file from the page cache so that every run starts cold
+static void dropCache(const char* name)
+{
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+/// baseline: plain read() through the page cache + crc32_16bytes
+static int crc32FileRead(const char* name, uint32_t& crc)
+{
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return errno;
+  const size_t BufferSize = 1024*1024;
+  char* buffer = new char[BufferSize];
+  crc = 0;
+  int error = 0;
+  for (;;)
+  {
+    ssize_t got = read(fd, buffer, BufferSize);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+    {
+      error = (got < 0 ? errno : 0);
+      break;
+    }
+    crc = crc32_16bytes(buffer, got, crc);
+  }
+  delete[] buffer;
+  close(fd);
+  return error;
+}
+
+static void report(const char* method, int error, uint32_t crc, uint64_t size, double wall, double cpu)
+{
+  if (error)
+    printf("%-22s: %s\n", method, strerror(error));
+  else
+    printf("%-22s: CRC=%08X, %.3fs, %.3f GB/s, CPU %.0f%%\n",
+           method, crc, wall, size / wall / 1e9, 100 * cpu / wall);
+}
+
+static int benchmark(const char* name, StreamOptions options, bool cold)
+{
+  struct stat info;
+  if (stat(name, &info) != 0)
+  {
+    fprintf(stderr, "crc32stream: %s: %s\n", name, strerror(errno));
+    return 1;
+  }
+  printf("%s: %.1f MB, %u x %zu KB buffers%s\n", name, info.st_size / 1e6,
+         options.queueDepth, options.bufferSize / 1024, cold ? ", page cache dropped before each run" : "");
+
+  for (int method = 0; method < 3; method++)
+  {
+    uint32_t crc = 0;
+    int error;
+    const char* title;
+    if (cold)
+      dropCache(name);
+
+    double wall = wallSeconds(), cpu = cpuSeconds();
+    if (method == 2)
+    {
+      title = "read() + crc32_16bytes";
+      error = crc32FileRead(name, crc);
+    }
+    else
+    {
+      StreamStats stats;
+      options.useUring = (method == 0);
+      error = crc32File(name, crc32_16bytes, crc, options, &stats);
+      title = stats.usedUring ? (stats.usedDirect ? "io_uring + O_DIRECT" : "io_uring")
+                              : (stats.usedDirect ? "pread + O_DIRECT"    : "pread");
+    }
+    wall = wallSeconds() - wall, cpu = cpuSeconds() - cpu;
+    report(title, error, crc, info.st_size, wall, cpu);
+  }
+  return 0;
+}
+
+
+/// numeric argument, 0 if it isn't a number between minimum and maximum
+static long parseNumber(const char* text, long minimum, long maximum)
+{
+  char* end;
+  errno = 0;
+  long value = strtol(text, &end, 10);
+  if (errno != 0 || end == text || *end != 0 || value < minimum || value > maximum)
+    return 0;
+  return value;
+}
+
+static void usage()
+{
+  printf("Usage: crc32stream [OPTION]... FILE...\n"
+         "Print CRC32 checksums of FILEs read with io_uring + O_DIRECT (pread fallback).\n"
+         "\n"
+         "  -C, --crc32c        use the CRC32C (Castagnoli) polynomial\n"
+         "  -q, --depth N       reads in flight (default 8)\n"
+         "  -b, --buffer KB     size of each read, a multiple of 4 (default 1024)\n"
+         "      --cached        don't use O_DIRECT\n"
+         "      --pread         don't use io_uring\n"
+         "      --bench         compare io_uring, pread and read() + crc32_16bytes on each FILE\n"
+         "      --warm          don't drop the page cache before each --bench run\n");
+}
+
+
+int main(int argc, char** argv)
+{
+  StreamOptions options;
+  Crc32Function crcFunction = crc32_16bytes;
+  bool bench = false, cold = true;
+  int  firstFile = argc;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char* arg = argv[i];
+    if (strcmp(arg, "-C") == 0 || strcmp(arg, "--crc32c") == 0)
+      crcFunction = crc32c_16bytes;
+    else if ((strcmp(arg, "-q") == 0 || strcmp(arg, "--depth") == 0) && i+1 < argc)
+    {
+      options.queueDepth = unsigned(parseNumber(argv[++i], 1, MaxQueueDepth));
+      if (options.queueDepth == 0)
+      {
+        fprintf(stderr, "crc32stream: invalid queue depth '%s' (1..%ld)\n", argv[i], MaxQueueDepth);
+        usage();
+        return 1;
+      }
+    }
+    else if ((strcmp(arg, "-b") == 0 || strcmp(arg, "--buffer") == 0) && i+1 < argc)
+    {
+      options.bufferSize = size_t(parseNumber(argv[++i], 1, MaxBufferKB)) * 1024;
+      if (options.bufferSize == 0 || options.bufferSize % DirectAlignment != 0)
+      {
+        fprintf(stderr, "crc32stream: invalid buffer size '%s' (a multiple of %zu up to %ld KB)\n",
+                argv[i], DirectAlignment / 1024, MaxBufferKB);
+        usage();
+        return 1;
+      }
+    }
+    else if (strcmp(arg, "--cached") == 0)
+      options.direct = false;
+    else if (strcmp(arg, "--pread") == 0)
+      options.useUring = false;
+    else if (strcmp(arg, "--bench") == 0)
+      bench = true;
+    else if (strcmp(arg, "--warm") == 0)
+      cold = false;
+    else if (arg[0] == '-')
+    {
+      usage();
+      return strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0 ? 0 : 1;
+    }
+    else
+    {
+      firstFile = i;
+      break;
+    }
+  }
+  if (firstFile == argc)
+  {
+    usage();
+    return 1;
+  }
+
+  init();
+
+  int exitCode = 0;
+  for (int i = firstFile; i < argc; i++)
+  {
+    if (bench)
+    {
+      exitCode |= benchmark(argv[i], options, cold);
+      continue;
+    }
+    uint32_t crc;
+    int error = crc32File(argv[i], crcFunction, crc, options);
+    if (error)
+    {
+      fprintf(stderr, "crc32stream: %s: %s\n", argv[i], strerror(error));
+      exitCode = 1;
+      continue;
+    }
+    printf("%08x  %s\n", crc, argv[i]);
+  }
+  return exitCode;
+}
@@ -0,0 +1,800 @@
+// //////////////////////////////////////////////////////////
+// crc32sum.cpp
+// md5sum/sha256sum-style command-line tool on top of the Crc32.cpp kernels:
+// large files are mmap'ed and split across threads by crc32_parallel (NUMA-aware, partial CRCs glued by crc32_combine),
+// small files are distributed over a work-stealing pool of threads;
+// optionally a persistent cache skips files whose identity (device, inode, size, mtime, ctime) didn't change
+
+// g++ -o crc32sum crc32sum.cpp -O3 -march=native -mtune=native -pthread
+
+#define CRC32_NO_BENCHMARK
+#include "Crc32.cpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/// files at least that large are mmap'ed and hashed by all threads together
+const uint64_t LargeFileSize = 16*1024*1024;
+/// read() buffer for small files and stdin
+const size_t   ReadBufferSize = 256*1024;
+/// upper limit of -j
+const long     MaxThreads = 1024;
+/// upper limits of --bench -n and -b
+const long     MaxBenchFiles = 10000000;
+const long     MaxBenchBytes = 64*1024*1024;
+
+
+/// selected polynomial
+static Crc32Function        crcFunction = crc32_fast;
+static Crc32CombineFunction crcCombine = crc32_combine;
+static int                  polynomialIndex = 0; // 0 = CRC32, 1 = CRC32C (slot in the cache entries)
+
+
+/// identity of one version of a file: if none of these changed, neither did the content
+struct FileIdentity
+{
+  uint64_t device, inode, size;
+  int64_t  mtime, ctime;   // nanoseconds
+
+  bool operator==(const FileIdentity& other) const
+  {
+    return device == other.device && inode == other.inode && size == other.size &&
+           mtime  == other.mtime  && ctime == other.ctime;
+  }
+};
+
+static FileIdentity fileIdentity(const struct stat& info)
+{
+  FileIdentity identity;
+  identity.device = info.st_dev;
+  identity.inode  = info.st_ino;
+  identity.size   = info.st_size;
+  identity.mtime  = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+  identity.ctime  = int64_t(info.st_ctim.tv_sec) * 1000000000 + info.st_ctim.tv_nsec;
+  return identity;
+}
+
+/// one file to hash
+struct Job
+{
+  std::string  name;
+  uint32_t     crc;
+  bool         ok;          // false if the file can't be read
+  int          error;       // errno if !ok
+  uint32_t     expected;    // --check mode only
+  FileIdentity identity;    // from stat() before hashing, regular files only
+  bool         stable;      // identity still the same after hashing: result may be cached
+  bool         cached;      // crc came from the cache (--audit: cachedCrc has to match crc)
+  uint32_t     cachedCrc;
+
+  Job() : crc(0), ok(false), error(0), expected(0), identity(), stable(false), cached(false), cachedCrc(0) {}
+};
+
+
+// //////////////////////////////////////////////////////////
+// persistent CRC cache: open-addressing hash table in an mmap'ed file, one slot per (device, inode)
+// holding size, mtime and ctime of the version that was hashed plus its CRC32 and CRC32C;
+// ctime can't be set from user space, so touch -d doesn't fool it
+
+/// one slot, 64 bytes
+struct CacheEntry
+{
+  FileIdentity identity;
+  uint32_t     crc[2];      // CRC32, CRC32C
+  uint32_t     valid;       // bit i: crc[i] is known, 0 = free slot
+  uint32_t     check;       // CRC32C of all fields above, an entry torn by a crash doesn't match
+  uint32_t     reserved[2];
+};
+
+struct CacheHeader
+{
+  char     magic[8];        // "crc32sum"
+  uint32_t version;
+  uint32_t entrySize;
+  uint64_t capacity;        // slots, power of two
+  uint64_t used;
+  uint8_t  reserved[32];
+};
+
+const uint32_t CacheVersion     = 1;
+const uint64_t CacheMinCapacity = 1 << 16;
+
+struct Cache
+{
+  int          fd;
+  CacheHeader* header;
+  CacheEntry*  entries;
+  size_t       mapped;
+
+  Cache() : fd(-1), header(NULL), entries(NULL), mapped(0) {}
+};
+
+static uint32_t cacheCheck(const CacheEntry& entry)
+{
+  // hashed as 64-bit words: the kernels read memory as integers, the struct itself would break strict aliasing
+  uint64_t words[6] = { entry.identity.device, entry.identity.inode, entry.identity.size,
+                        uint64_t(entry.identity.mtime), uint64_t(entry.identity.ctime),
+                        entry.crc[0] | uint64_t(entry.crc[1]) << 32 };
+  return crc32c_fast(words, sizeof(words), entry.valid);
+}
+
+/// map the file for a table of the given capacity (the file is resized, the content isn't touched);
+/// on failure the previous mapping and file size stay as they were
+static bool cacheMap(Cache& cache, uint64_t capacity)
+{
+  size_t size = sizeof(CacheHeader) + capacity * sizeof(CacheEntry);
+  if (ftruncate(cache.fd, off_t(size)) != 0)
+    return false;
+  void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache.fd, 0);
+  if (mapped == MAP_FAILED)
+  {
+    // back to the size the header describes, otherwise the next cacheOpen discards the whole cache
+    int error = errno;
+    if (cache.header && ftruncate(cache.fd, off_t(cache.mapped)) != 0) {}
+    errno = error;
+    return false;
+  }
+  if (cache.header)
+    munmap(cache.header, cache.mapped);
+  cache.header  = (CacheHeader*) mapped;
+  cache.entries = (CacheEntry*) (cache.header + 1);
+  cache.mapped  = size;
+  return true;
+}
+
+/// open or create the cache, other crc32sum processes using the same file wait until it's closed
+static bool cacheOpen(Cache& cache, const char* path)
+{
+  cache.fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (cache.fd < 0 || flock(cache.fd, LOCK_EX) != 0)
+    return false;
+
+  struct stat info;
+  if (fstat(cache.fd, &info) != 0)
+    return false;
+  CacheHeader existing;
+  bool valid = size_t(info.st_size) >= sizeof(existing) && pread(cache.fd, &existing, sizeof(existing), 0) == sizeof(existing) &&
+               memcmp(existing.magic, "crc32sum", 8) == 0 && existing.version == CacheVersion &&
+               existing.entrySize == sizeof(CacheEntry) && existing.capacity >= CacheMinCapacity &&
+               (existing.capacity & (existing.capacity - 1)) == 0 &&
+               uint64_t(info.st_size) == sizeof(existing) + existing.capacity * sizeof(CacheEntry);
+  if (valid)
+    return cacheMap(cache, existing.capacity);
+
+  // new file (or unusable: start over)
+  if (ftruncate(cache.fd, 0) != 0 || !cacheMap(cache, CacheMinCapacity))
+    return false;
+  memcpy(cache.header->magic, "crc32sum", 8);
+  cache.header->version   = CacheVersion;
+  cache.header->entrySize = sizeof(CacheEntry);
+  cache.header->capacity  = CacheMinCapacity;
+  cache.header->used      = 0;
+  return true;
+}
+
+static void cacheClose(Cache& cache)
+{
+  if (cache.header)
+    munmap(cache.header, cache.mapped);
+  if (cache.fd >= 0)
+    close(cache.fd); // releases the lock
+  cache = Cache();
+}
+
+/// slot of a file: the one with the same device and inode or the free slot where it belongs
+static CacheEntry& cacheSlot(Cache& cache, const FileIdentity& identity)
+{
+  uint64_t key[2] = { identity.device, identity.inode };
+  uint32_t hash;
+  crc32c_hash_u128(key, 1, 0, &hash);
+  uint64_t mask = cache.header->capacity - 1;
+  for (uint64_t slot = hash & mask; ; slot = (slot + 1) & mask)
+  {
+    CacheEntry& entry = cache.entries[slot];
+    if (entry.valid == 0 || (entry.identity.device == identity.device && entry.identity.inode == identity.inode))
+      return entry;
+  }
+}
+
+/// CRC of exactly this version of the file, false if unknown
+static bool cacheLookup(Cache& cache, const FileIdentity& identity, uint32_t& crc)
+{
+  const CacheEntry& entry = cacheSlot(cache, identity);
+  if (!(entry.valid & (1 << polynomialIndex)) || !(entry.identity == identity) || entry.check != cacheCheck(entry))
+    return false;
+  crc = entry.crc[polynomialIndex];
+  return true;
+}
+
+/// remember a CRC, replaces what was stored for an older version of the file;
+/// false (errno set) if the table is full and can't grow, it is still usable then
+static bool cacheStore(Cache& cache, const FileIdentity& identity, uint32_t crc)
+{
+  // keep at most 50% of the slots occupied (deleted files keep theirs), rebuild twice as large
+  if (2 * (cache.header->used + 1) > cache.header->capacity)
+  {
+    uint64_t capacity = cache.header->capacity;
+    std::vector<CacheEntry> old(cache.entries, cache.entries + capacity);
+    if (!cacheMap(cache, 2 * capacity))
+      return false;
+    cache.header->capacity = 2 * capacity;
+    cache.header->used     = 0;
+    memset(cache.entries, 0, capacity * 2 * sizeof(CacheEntry));
+    for (uint64_t i = 0; i < capacity; i++)
+      if (old[i].valid != 0 && old[i].check == cacheCheck(old[i]))
+      {
+        cacheSlot(cache, old[i].identity) = old[i];
+        cache.header->used++;
+      }
+  }
+
+  CacheEntry& entry = cacheSlot(cache, identity);
+  if (entry.valid == 0)
+    cache.header->used++;
+  if (!(entry.identity == identity) || entry.check != cacheCheck(entry))
+  {
+    memset(&entry, 0, sizeof(entry));
+    entry.identity = identity;
+  }
+  entry.crc[polynomialIndex] = crc;
+  entry.valid |= 1 << polynomialIndex;
+  entry.check  = cacheCheck(entry);
+  return true;
+}
+
+/// what the cache is used for
+enum CacheMode
+{
+  CacheOff,
+  CacheUse,    // skip files that didn't change
+  CacheRehash, // hash everything, refresh the cache
+  CacheAudit   // hash everything, report files whose content changed although their identity didn't
+};
+
+static Cache     cache;
+static CacheMode cacheMode = CacheOff;
+
+
+/// hash the whole stream with read()
+static bool hashStream(int fd, uint32_t& crc, char* buffer)
+{
+  crc = 0;
+  for (;;)
+  {
+    ssize_t got = read(fd, buffer, ReadBufferSize);
+    if (got == 0)
+      return true;
+    if (got < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    crc = crcFunction(buffer, got, crc);
+  }
+}
+
+
+/// hash a large file: mmap it and let crc32_parallel split it across all threads
+static void hashLargeFile(Job& job, int fd, uint64_t size, unsigned numThreads)
+{
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED)
+  {
+    job.ok = false, job.error = errno;
+    return;
+  }
+  madvise(mapped, size, MADV_SEQUENTIAL);
+
+  job.crc = crc32_parallel(mapped, size, 0, numThreads, crcFunction, crcCombine);
+  job.ok  = true;
+  munmap(mapped, size);
+}
+
+
+/// true if the file wasn't modified while it was hashed and not so recently that a later write
+/// could still get the same timestamps (coarse-grained filesystem clocks)
+static bool isStable(const Job& job, int fd, time_t startTime)
+{
+  struct stat info;
+  return fstat(fd, &info) == 0 && fileIdentity(info) == job.identity &&
+         info.st_mtime < startTime - 1 && info.st_ctime < startTime - 1;
+}
+
+
+/// per-thread queue of jobs; the owner pops from the front, thieves from the back
+struct WorkQueue
+{
+  std::mutex         lock;
+  std::deque<size_t> jobs;
+};
+
+static bool popJob(std::vector<WorkQueue>& queues, unsigned self, size_t& job)
+{
+  for (unsigned i = 0; i < queues.size(); i++)
+  {
+    WorkQueue& queue = queues[(self + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.jobs.empty())
+      continue;
+    if (i == 0)
+      job = queue.jobs.front(), queue.jobs.pop_front();
+    else
+      job = queue.jobs.back(),  queue.jobs.pop_back();
+    return true;
+  }
+  return false;
+}
+
+static void smallFileWorker(std::vector<Job>& jobs, std::vector<WorkQueue>& queues, unsigned self, time_t startTime)
+{
+  std::vector<char> buffer(ReadBufferSize);
+  size_t index;
+  while (popJob(queues, self, index))
+  {
+    Job& job = jobs[index];
+    int fd = open(job.name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      job.ok = false, job.error = errno;
+      continue;
+    }
+    job.ok = hashStream(fd, job.crc, &buffer[0]);
+    if (!job.ok)
+      job.error = errno;
+    else if (job.identity.inode != 0)
+      job.stable = isStable(job, fd, startTime);
+    close(fd);
+  }
+}
+
+
+/// compute CRCs of all jobs (or take them from the cache)
+static void hashAll(std::vector<Job>& jobs, unsigned numThreads)
+{
+  std::vector<size_t> small;
+  std::vector<char>   buffer(ReadBufferSize);
+  time_t startTime = time(NULL);
+
+  for (size_t i = 0; i < jobs.size(); i++)
+  {
+    Job& job = jobs[i];
+    if (job.name == "-")
+    {
+      job.ok = hashStream(STDIN_FILENO, job.crc, &buffer[0]);
+      if (!job.ok)
+        job.error = errno;
+      continue;
+    }
+
+    struct stat info;
+    if (stat(job.name.c_str(), &info) != 0)
+    {
+      job.ok = false, job.error = errno;
+      continue;
+    }
+    if (S_ISDIR(info.st_mode))
+    {
+      job.ok = false, job.error = EISDIR;
+      continue;
+    }
+    if (S_ISREG(info.st_mode))
+    {
+      job.identity = fileIdentity(info);
+      if (cacheMode == CacheUse || cacheMode == CacheAudit)
+        job.cached = cacheLookup(cache, job.identity, job.cachedCrc);
+      if (job.cached && cacheMode == CacheUse)
+      {
+        job.crc = job.cachedCrc;
+        job.ok  = true;
+        continue;
+      }
+    }
+    if (!S_ISREG(info.st_mode) || uint64_t(info.st_size) < LargeFileSize)
+    {
+      small.push_back(i);
+      continue;
+    }
+
+    // large files are processed one at a time by all threads
+    int fd = open(job.name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      job.ok = false, job.error = errno;
+      continue;
+    }
+    hashLargeFile(job, fd, info.st_size, numThreads);
+    if (job.ok)
+      job.stable = isStable(job, fd, startTime);
+    close(fd);
+  }
+
+  // small files: contiguous runs per thread, idle threads steal from the others
+  std::vector<WorkQueue> queues(numThreads);
+  for (size_t i = 0; i < small.size(); i++)
+    queues[i * numThreads / small.size()].jobs.push_back(small[i]);
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < numThreads; t++)
+    threads.push_back(std::thread(smallFileWorker, std::ref(jobs), std::ref(queues), t, startTime));
+  smallFileWorker(jobs, queues, 0, startTime);
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  // remember the new CRCs
+  if (cacheMode == CacheOff)
+    return;
+  for (size_t i = 0; i < jobs.size(); i++)
+  {
+    const Job& job = jobs[i];
+    // an audit keeps the old CRC of a file that changed behind the cache's back
+    bool mismatch = job.cached && job.crc != job.cachedCrc;
+    if (job.ok && job.stable && !mismatch && !cacheStore(cache, job.identity, job.crc))
+    {
+      fprintf(stderr, "crc32sum: cache can't grow, not all CRCs stored: %s\n", strerror(errno));
+      break;
+    }
+  }
+}
+
+
+/// read "<crc>  <name>" lines (also accepts " *<name>" as written by *sum -b)
+static bool readChecklist(const char* listName, std::vector<Job>& jobs, size_t& malformed)
+{
+  FILE* list = strcmp(listName, "-") == 0 ? stdin : fopen(listName, "r");
+  if (!list)
+  {
+    fprintf(stderr, "crc32sum: %s: %s\n", listName, strerror(errno));
+    return false;
+  }
+
+  char line[64*1024];
+  while (fgets(line, sizeof(line), list))
+  {
+    size_t length = strlen(line);
+    while (length > 0 && (line[length-1] == '\n' || line[length-1] == '\r'))
+      line[--length] = 0;
+    if (length == 0)
+      continue;
+
+    char* end;
+    unsigned long crc = strtoul(line, &end, 16);
+    if (end != line + 8 || *end != ' ' || (end[1] != ' ' && end[1] != '*') || end[2] == 0)
+    {
+      malformed++;
+      continue;
+    }
+
+    Job job;
+    job.name     = end + 2;
+    job.expected = uint32_t(crc);
+    jobs.push_back(job);
+  }
+
+  if (list != stdin)
+    fclose(list);
+  return true;
+}
+
+
+/// wall-clock time
+static double wallSeconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/// --bench: create a tree of numFiles files (1000 per directory, an existing tree is reused),
+/// then hash it without cache, with an empty cache, with the filled cache and in audit mode
+static int benchmark(const char* root, size_t numFiles, size_t fileSize, unsigned numThreads)
+{
+  std::vector<Job> files;
+  std::vector<char> content(fileSize);
+  size_t created = 0;
+  mkdir(root, 0755);
+  for (size_t i = 0; i < numFiles; i++)
+  {
+    char name[4096];
+    snprintf(name, sizeof(name), "%s/%04u", root, unsigned(i / 1000));
+    if (i % 1000 == 0)
+      mkdir(name, 0755);
+    snprintf(name, sizeof(name), "%s/%04u/%06u", root, unsigned(i / 1000), unsigned(i));
+    Job job;
+    job.name = name;
+    files.push_back(job);
+
+    struct stat info;
+    if (stat(name, &info) == 0 && size_t(info.st_size) == fileSize)
+      continue;
+    for (size_t b = 0; b < fileSize; b++)
+      content[b] = char(i * 31 + b * 7);
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+      fprintf(stderr, "crc32sum: %s: %s\n", name, strerror(errno));
+      return 1;
+    }
+    ssize_t written = write(fd, &content[0], fileSize);
+    if (written != ssize_t(fileSize))
+    {
+      fprintf(stderr, "crc32sum: %s: %s\n", name, written < 0 ? strerror(errno) : "short write");
+      close(fd);
+      return 1;
+    }
+    close(fd);
+    created++;
+  }
+  printf("%u files of %u bytes in %s (%u created), %u threads, page cache warm\n",
+         unsigned(numFiles), unsigned(fileSize), root, unsigned(created), numThreads);
+  // files modified within the last seconds aren't cached
+  if (created > 0)
+    sleep(2);
+
+  std::string cachePath = std::string(root) + ".crc32cache";
+  unlink(cachePath.c_str());
+
+  struct Run { const char* name; CacheMode mode; };
+  static const Run Runs[] =
+  {
+    { "no cache     ", CacheOff   },
+    { "empty cache  ", CacheUse   },
+    { "filled cache ", CacheUse   },
+    { "audit        ", CacheAudit },
+  };
+  std::vector<Job> reference;
+  bool ok = true;
+  for (size_t r = 0; r < sizeof(Runs) / sizeof(Runs[0]); r++)
+  {
+    cacheMode = Runs[r].mode;
+    if (cacheMode != CacheOff && !cacheOpen(cache, cachePath.c_str()))
+    {
+      fprintf(stderr, "crc32sum: %s: %s\n", cachePath.c_str(), strerror(errno));
+      return 1;
+    }
+    std::vector<Job> jobs = files;
+    double startTime = wallSeconds();
+    hashAll(jobs, numThreads);
+    double duration = wallSeconds() - startTime;
+
+    size_t fromCache = 0, wrong = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+      fromCache += (jobs[i].cached && cacheMode == CacheUse);
+      if (!jobs[i].ok || (!reference.empty() && jobs[i].crc != reference[i].crc) ||
+          (jobs[i].cached && jobs[i].cachedCrc != jobs[i].crc))
+        wrong++;
+    }
+    if (reference.empty())
+      reference = jobs;
+    struct stat info;
+    unsigned long long cacheBytes = (cacheMode != CacheOff && fstat(cache.fd, &info) == 0) ? info.st_size : 0;
+    cacheClose(cache);
+
+    printf("%s: %8.3f s, %10.0f files/s, %u from cache, cache file %llu KB, %s\n",
+           Runs[r].name, duration, jobs.size() / duration, unsigned(fromCache), cacheBytes / 1024,
+           wrong ? "ERRORS" : "CRCs ok");
+    if (wrong)
+      ok = false;
+  }
+  cacheMode = CacheOff;
+  return ok ? 0 : 1;
+}
+
+
+/// numeric argument, 0 if it isn't a number between minimum and maximum
+static long parseNumber(const char* text, long minimum, long maximum)
+{
+  char* end;
+  errno = 0;
+  long value = strtol(text, &end, 10);
+  if (errno != 0 || end == text || *end != 0 || value < minimum || value > maximum)
+    return 0;
+  return value;
+}
+
+/// -j argument, 0 if it isn't a number between 1 and MaxThreads
+static unsigned parseThreads(const char* text)
+{
+  return unsigned(parseNumber(text, 1, MaxThreads));
+}
+
+static void usage()
+{
+  printf("Usage: crc32sum [OPTION]... [FILE]...\n"
+         "Print or check CRC32 checksums (zlib polynomial by default).\n"
+         "With no FILE, or when FILE is -, read standard input.\n"
+         "\n"
+         "  -c, --check       read checksums from the FILEs and check them\n"
+         "  -C, --crc32c      use the CRC32C (Castagnoli) polynomial\n"
+         "  -j, --threads N   use N threads (default: all cores)\n"
+         "      --quiet       don't print OK for each successfully verified file\n"
+         "      --cache FILE  skip files whose device, inode, size, mtime and ctime are in the cache\n"
+         "      --rehash      with --cache: hash all files anyway and refresh the cache\n"
+         "      --audit       with --cache: hash all files and report those whose content changed\n"
+         "                    although size, mtime and ctime didn't (silent corruption)\n"
+         "      --bench DIR   hash a tree of FILES files in DIR (created if needed) with and without cache\n"
+         "  -n FILES          --bench: number of files (default 1000000)\n"
+         "  -b BYTES          --bench: bytes per file (default 4096)\n"
+         "  -h, --help        display this help and exit\n");
+}
+
+
+int main(int argc, char** argv)
+{
+  bool check = false, quiet = false;
+  unsigned numThreads = std::thread::hardware_concurrency();
+  std::vector<const char*> names;
+  const char* cachePath = NULL;
+  const char* benchRoot = NULL;
+  size_t benchFiles = 1000000, benchBytes = 4096;
+  bool rehash = false, audit = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char* arg = argv[i];
+    if (strcmp(arg, "--") == 0)
+    {
+      while (++i < argc)
+        names.push_back(argv[i]);
+      break;
+    }
+    else if (strcmp(arg, "-c") == 0 || strcmp(arg, "--check") == 0)
+      check = true;
+    else if (strcmp(arg, "-C") == 0 || strcmp(arg, "--crc32c") == 0)
+      crcFunction = crc32c_fast, crcCombine = crc32c_combine, polynomialIndex = 1;
+    else if (strcmp(arg, "--quiet") == 0)
+      quiet = true;
+    else if (strcmp(arg, "--cache") == 0 && i+1 < argc)
+      cachePath = argv[++i];
+    else if (strcmp(arg, "--rehash") == 0)
+      rehash = true;
+    else if (strcmp(arg, "--audit") == 0)
+      audit = true;
+    else if (strcmp(arg, "--bench") == 0 && i+1 < argc)
+      benchRoot = argv[++i];
+    else if (strcmp(arg, "-n") == 0 && i+1 < argc)
+    {
+      benchFiles = size_t(parseNumber(argv[++i], 1, MaxBenchFiles));
+      if (benchFiles == 0)
+      {
+        fprintf(stderr, "crc32sum: invalid number of files '%s' (1..%ld)\n", argv[i], MaxBenchFiles);
+        usage();
+        return 1;
+      }
+    }
+    else if (strcmp(arg, "-b") == 0 && i+1 < argc)
+    {
+      benchBytes = size_t(parseNumber(argv[++i], 1, MaxBenchBytes));
+      if (benchBytes == 0)
+      {
+        fprintf(stderr, "crc32sum: invalid file size '%s' (1..%ld bytes)\n", argv[i], MaxBenchBytes);
+        usage();
+        return 1;
+      }
+    }
+    else if ((strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0) && i+1 < argc)
+    {
+      numThreads = parseThreads(argv[++i]);
+      if (numThreads == 0)
+      {
+        fprintf(stderr, "crc32sum: invalid number of threads '%s'\n", argv[i]);
+        usage();
+        return 1;
+      }
+    }
+    else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+    {
+      usage();
+      return 0;
+    }
+    else if (arg[0] == '-' && arg[1] != 0)
+    {
+      fprintf(stderr, "crc32sum: invalid option '%s'\nTry 'crc32sum --help' for more information.\n", arg);
+      return 1;
+    }
+    else
+      names.push_back(arg);
+  }
+  if (names.empty())
+    names.push_back("-");
+  if (numThreads < 1)
+    numThreads = 1;
+  if ((rehash || audit) && !cachePath)
+  {
+    fprintf(stderr, "crc32sum: --rehash and --audit need --cache FILE\n");
+    return 1;
+  }
+
+  init();
+  if (benchRoot)
+    return benchmark(benchRoot, benchFiles, benchBytes, numThreads);
+
+  if (cachePath)
+  {
+    if (!cacheOpen(cache, cachePath))
+    {
+      fprintf(stderr, "crc32sum: %s: %s\n", cachePath, strerror(errno));
+      return 1;
+    }
+    cacheMode = audit ? CacheAudit : (rehash ? CacheRehash : CacheUse);
+  }
+
+  // collect the jobs
+  std::vector<Job> jobs;
+  size_t malformed = 0;
+  int exitCode = 0;
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    if (check)
+    {
+      if (!readChecklist(names[i], jobs, malformed))
+        exitCode = 1;
+      continue;
+    }
+    Job job;
+    job.name = names[i];
+    jobs.push_back(job);
+  }
+
+  hashAll(jobs, numThreads);
+  cacheClose(cache);
+
+  // report in the input order
+  size_t failed = 0, unreadable = 0, corrupted = 0;
+  for (size_t i = 0; i < jobs.size(); i++)
+  {
+    const Job& job = jobs[i];
+    if (!job.ok)
+    {
+      fprintf(stderr, "crc32sum: %s: %s\n", job.name.c_str(), strerror(job.error));
+      if (check)
+        printf("%s: FAILED open or read\n", job.name.c_str());
+      unreadable++;
+      continue;
+    }
+    if (cacheMode == CacheAudit && job.cached && job.crc != job.cachedCrc)
+    {
+      fprintf(stderr, "crc32sum: %s: content changed but size, mtime and ctime didn't (cached %08x)\n",
+              job.name.c_str(), job.cachedCrc);
+      corrupted++;
+    }
+    if (!check)
+      printf("%08x  %s\n", job.crc, job.name.c_str());
+    else if (job.crc != job.expected)
+    {
+      printf("%s: FAILED\n", job.name.c_str());
+      failed++;
+    }
+    else if (!quiet)
+      printf("%s: OK\n", job.name.c_str());
+  }
+
+  fflush(stdout);
+  if (malformed)
+    fprintf(stderr, "crc32sum: WARNING: %zu line%s improperly formatted\n", malformed, malformed == 1 ? " is" : "s are");
+  if (check && unreadable)
+    fprintf(stderr, "crc32sum: WARNING: %zu listed file%s could not be read\n", unreadable, unreadable == 1 ? "" : "s");
+  if (failed)
+    fprintf(stderr, "crc32sum: WARNING: %zu computed checksum%s did NOT match\n", failed, failed == 1 ? "" : "s");
+  if (corrupted)
+    fprintf(stderr, "crc32sum: WARNING: %zu file%s changed without a new mtime/ctime\n", corrupted, corrupted == 1 ? "" : "s");
+
+  if (failed || unreadable || corrupted || (check && malformed))
+    exitCode = 1;
+  return exitCode;
+}
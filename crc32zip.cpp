@@ -0,0 +1,514 @@
+// //////////////////////////////////////////////////////////
+// crc32zip.cpp
+// batch verification of CRC32 values recorded in zip and gzip archives.
+// Zip: the central directory is parsed and all stored (uncompressed) entries are checked in parallel,
+//      large entries are split across threads and their partial CRCs glued by crc32_combine.
+// Gzip: members whose deflate stream consists of stored blocks are checked against the trailer.
+// Compressed data is reported as skipped since there is no inflater here.
+
+// g++ -o crc32zip crc32zip.cpp -O3 -march=native -mtune=native -pthread
+
+#define CRC32_NO_BENCHMARK
+#include "Crc32.cpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/// stored entries larger than that are split across threads
+const uint64_t ChunkSize = 4*1024*1024;
+/// upper limit of -j
+const long     MaxThreads = 1024;
+
+
+/// little-endian readers, the caller checks bounds
+static inline uint16_t get16(const uint8_t* p) { return uint16_t(p[0] | (p[1] << 8)); }
+static inline uint32_t get32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+static inline uint64_t get64(const uint8_t* p) { return get32(p) | (uint64_t(get32(p + 4)) << 32); }
+
+
+/// a memory-mapped archive
+struct Archive
+{
+  std::string    name;
+  const uint8_t* data;
+  uint64_t       size;
+  bool           isGzip;
+  // results
+  size_t         verified, skipped, encrypted, failed;
+  std::string    error;    // archive can't be parsed
+
+  Archive() : data(NULL), size(0), isGzip(false), verified(0), skipped(0), encrypted(0), failed(0) {}
+};
+
+/// one stored zip entry
+struct Entry
+{
+  Archive*       archive;
+  std::string    name;
+  const uint8_t* data;
+  uint64_t       size;
+  uint32_t       expected;
+  size_t         firstChunk, numChunks;
+};
+
+/// unit of work for the thread pool: a slice of a zip entry or a whole gzip file
+struct Task
+{
+  Archive*       archive;  // gzip task if entry == NULL
+  Entry*         entry;
+  uint64_t       offset, length;
+  uint32_t       crc;
+};
+
+
+// //////////////////////////////////////////////////////////
+// zip
+
+/// locate the central directory, returns false and sets archive.error if it's damaged
+static bool findCentralDirectory(Archive& archive, uint64_t& offset, uint64_t& size, uint64_t& numEntries)
+{
+  const uint8_t* data = archive.data;
+  const uint64_t EndRecordSize = 22;
+  if (archive.size < EndRecordSize)
+  {
+    archive.error = "too small for a zip file";
+    return false;
+  }
+
+  // end of central directory record, followed by a comment of at most 64 KB
+  uint64_t end = archive.size - EndRecordSize;
+  uint64_t stop = end > 0xFFFF ? end - 0xFFFF : 0;
+  for (;; end--)
+  {
+    if (get32(data + end) == 0x06054b50 && end + EndRecordSize + get16(data + end + 20) == archive.size)
+      break;
+    if (end == stop)
+    {
+      archive.error = "end of central directory not found";
+      return false;
+    }
+  }
+  numEntries = get16(data + end + 10);
+  size       = get32(data + end + 12);
+  offset     = get32(data + end + 16);
+
+  // zip64 locator precedes the end record
+  if (end >= 20 && get32(data + end - 20) == 0x07064b50)
+  {
+    uint64_t record = get64(data + end - 20 + 8);
+    if (record > archive.size || archive.size - record < 56 || get32(data + record) != 0x06064b50)
+    {
+      archive.error = "damaged zip64 end of central directory";
+      return false;
+    }
+    numEntries = get64(data + record + 32);
+    size       = get64(data + record + 40);
+    offset     = get64(data + record + 48);
+  }
+
+  if (offset > archive.size || size > archive.size - offset)
+  {
+    archive.error = "central directory out of bounds";
+    return false;
+  }
+  return true;
+}
+
+/// collect stored entries of a zip archive
+static void parseZip(Archive& archive, std::vector<Entry>& entries)
+{
+  uint64_t offset, size, numEntries;
+  if (!findCentralDirectory(archive, offset, size, numEntries))
+    return;
+
+  const uint8_t* data = archive.data;
+  const uint8_t* record = data + offset;
+  const uint8_t* end    = record + size;
+  for (uint64_t i = 0; i < numEntries; i++)
+  {
+    if (end - record < 46 || get32(record) != 0x02014b50)
+    {
+      archive.error = "damaged central directory";
+      return;
+    }
+    uint16_t flags          = get16(record + 8);
+    uint16_t method         = get16(record + 10);
+    uint32_t crc            = get32(record + 16);
+    uint64_t compressed     = get32(record + 20);
+    uint64_t uncompressed   = get32(record + 24);
+    uint16_t nameLength     = get16(record + 28);
+    uint16_t extraLength    = get16(record + 30);
+    uint16_t commentLength  = get16(record + 32);
+    uint64_t localHeader    = get32(record + 42);
+    if (uint64_t(end - record) < 46u + nameLength + extraLength + commentLength)
+    {
+      archive.error = "damaged central directory";
+      return;
+    }
+    std::string name((const char*) record + 46, nameLength);
+
+    // zip64 extended information replaces the fields set to 0xFFFFFFFF, in this order
+    const uint8_t* extra    = record + 46 + nameLength;
+    const uint8_t* extraEnd = extra + extraLength;
+    while (extraEnd - extra >= 4)
+    {
+      uint16_t id = get16(extra), length = get16(extra + 2);
+      const uint8_t* field = extra + 4;
+      if (extraEnd - field < length)
+        break;
+      if (id == 0x0001)
+      {
+        const uint8_t* fieldEnd = field + length;
+        if (uncompressed == 0xFFFFFFFF && fieldEnd - field >= 8) uncompressed = get64(field), field += 8;
+        if (compressed   == 0xFFFFFFFF && fieldEnd - field >= 8) compressed   = get64(field), field += 8;
+        if (localHeader  == 0xFFFFFFFF && fieldEnd - field >= 8) localHeader  = get64(field), field += 8;
+      }
+      extra += 4 + length;
+    }
+    record += 46 + nameLength + extraLength + commentLength;
+
+    // directories have nothing to check
+    if (!name.empty() && name[name.size() - 1] == '/')
+      continue;
+    // the CRC covers the plaintext, encrypted data can't be checked
+    if (flags & 1)
+    {
+      archive.encrypted++;
+      continue;
+    }
+    if (method != 0)
+    {
+      archive.skipped++;
+      continue;
+    }
+
+    // the local header has its own name and extra field lengths
+    if (localHeader > archive.size || archive.size - localHeader < 30 || get32(data + localHeader) != 0x04034b50)
+    {
+      archive.error = "damaged local header of " + name;
+      return;
+    }
+    uint64_t start = localHeader + 30 + get16(data + localHeader + 26) + get16(data + localHeader + 28);
+    if (start > archive.size || uncompressed > archive.size - start || compressed != uncompressed)
+    {
+      archive.error = "stored data out of bounds: " + name;
+      return;
+    }
+
+    Entry entry;
+    entry.archive  = &archive;
+    entry.name     = name;
+    entry.data     = data + start;
+    entry.size     = uncompressed;
+    entry.expected = crc;
+    entries.push_back(entry);
+  }
+}
+
+
+// //////////////////////////////////////////////////////////
+// gzip
+
+/// LSB-first bit reader over a deflate stream
+struct BitReader
+{
+  const uint8_t* current;
+  const uint8_t* end;
+  uint32_t bits, numBits;
+
+  bool get(unsigned count, uint32_t& value)
+  {
+    while (numBits < count)
+    {
+      if (current == end)
+        return false;
+      bits |= uint32_t(*current++) << numBits;
+      numBits += 8;
+    }
+    value = bits & ((1u << count) - 1);
+    bits >>= count, numBits -= count;
+    return true;
+  }
+};
+
+/// check all members of a gzip file, stops at the first member using compressed blocks
+static void verifyGzip(Archive& archive)
+{
+  const uint8_t* current = archive.data;
+  const uint8_t* end     = archive.data + archive.size;
+  while (current < end)
+  {
+    if (end - current < 18 || current[0] != 0x1f || current[1] != 0x8b || current[2] != 8)
+    {
+      archive.error = "bad gzip header";
+      return;
+    }
+    uint8_t flags = current[3];
+    current += 10;
+    if (flags & 4)  // FEXTRA
+    {
+      if (end - current < 2 || end - current - 2 < get16(current))
+      {
+        archive.error = "truncated gzip header";
+        return;
+      }
+      current += 2 + get16(current);
+    }
+    if (flags & 8)  // FNAME
+      while (current < end && *current++) {}
+    if (flags & 16) // FCOMMENT
+      while (current < end && *current++) {}
+    if (flags & 2)  // FHCRC
+      current += 2;
+    if (current >= end)
+    {
+      archive.error = "truncated gzip header";
+      return;
+    }
+
+    // walk the deflate blocks, only stored ones can be checked without inflating
+    BitReader reader = { current, end, 0, 0 };
+    uint32_t crc = 0, final = 0, type;
+    uint64_t total = 0;
+    while (!final)
+    {
+      if (!reader.get(1, final) || !reader.get(2, type))
+      {
+        archive.error = "truncated deflate stream";
+        return;
+      }
+      if (type != 0)
+      {
+        archive.skipped++;
+        return;
+      }
+      // stored block: byte-aligned LEN, NLEN, data
+      reader.bits = reader.numBits = 0;
+      if (reader.end - reader.current < 4)
+      {
+        archive.error = "truncated stored block";
+        return;
+      }
+      uint16_t length = get16(reader.current);
+      if (uint16_t(~get16(reader.current + 2)) != length || reader.end - reader.current - 4 < length)
+      {
+        archive.error = "damaged stored block";
+        return;
+      }
+      crc = crc32_2x16bytes(reader.current + 4, length, crc);
+      total += length;
+      reader.current += 4 + length;
+    }
+
+    if (end - reader.current < 8)
+    {
+      archive.error = "truncated gzip trailer";
+      return;
+    }
+    if (get32(reader.current) == crc && get32(reader.current + 4) == uint32_t(total))
+      archive.verified++;
+    else
+    {
+      printf("%s: member at offset %llu: FAILED (recorded %08x, computed %08x)\n", archive.name.c_str(),
+             (unsigned long long) (current - archive.data), get32(reader.current), crc);
+      archive.failed++;
+    }
+    current = reader.current + 8;
+  }
+}
+
+
+// //////////////////////////////////////////////////////////
+// driver
+
+static void worker(std::vector<Task>& tasks, std::atomic<size_t>& next)
+{
+  for (;;)
+  {
+    size_t i = next.fetch_add(1);
+    if (i >= tasks.size())
+      return;
+    Task& task = tasks[i];
+    if (task.entry)
+      task.crc = crc32_2x16bytes(task.entry->data + task.offset, task.length);
+    else
+      verifyGzip(*task.archive);
+  }
+}
+
+static bool openArchive(Archive& archive)
+{
+  int fd = open(archive.name.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    archive.error = strerror(errno);
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    archive.error = strerror(errno);
+    close(fd);
+    return false;
+  }
+  archive.size = info.st_size;
+  if (archive.size == 0)
+  {
+    close(fd);
+    archive.error = "empty file";
+    return false;
+  }
+  void* mapped = mmap(NULL, archive.size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    archive.error = strerror(errno);
+    return false;
+  }
+  madvise(mapped, archive.size, MADV_WILLNEED);
+  archive.data   = (const uint8_t*) mapped;
+  archive.isGzip = archive.size >= 2 && archive.data[0] == 0x1f && archive.data[1] == 0x8b;
+  return true;
+}
+
+
+/// -j argument, 0 if it isn't a number between 1 and MaxThreads
+static unsigned parseThreads(const char* text)
+{
+  char* end;
+  errno = 0;
+  long value = strtol(text, &end, 10);
+  if (errno != 0 || end == text || *end != 0 || value < 1 || value > MaxThreads)
+    return 0;
+  return unsigned(value);
+}
+
+static void usage()
+{
+  printf("Usage: crc32zip [-j THREADS] ARCHIVE...\n"
+         "Verify CRC32 of stored zip entries and of gzip members made of stored blocks.\n");
+}
+
+
+int main(int argc, char** argv)
+{
+  unsigned numThreads = std::thread::hardware_concurrency();
+  std::vector<Archive> archives;
+  for (int i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0) && i+1 < argc)
+    {
+      numThreads = parseThreads(argv[++i]);
+      if (numThreads == 0)
+      {
+        fprintf(stderr, "crc32zip: invalid number of threads '%s'\n", argv[i]);
+        usage();
+        return 1;
+      }
+    }
+    else if (argv[i][0] == '-')
+    {
+      usage();
+      return strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 ? 0 : 1;
+    }
+    else
+    {
+      archives.push_back(Archive());
+      archives.back().name = argv[i];
+    }
+  }
+  if (archives.empty())
+  {
+    usage();
+    return 1;
+  }
+  if (numThreads < 1)
+    numThreads = 1;
+
+  init();
+
+  // parse everything first (archives must not move afterwards: entries point into them)
+  std::vector<Entry> entries;
+  std::vector<Task>  tasks;
+  for (size_t i = 0; i < archives.size(); i++)
+  {
+    Archive& archive = archives[i];
+    if (!openArchive(archive))
+      continue;
+    if (archive.isGzip)
+    {
+      Task task = { &archive, NULL, 0, 0, 0 };
+      tasks.push_back(task);
+    }
+    else
+      parseZip(archive, entries);
+  }
+  for (size_t i = 0; i < entries.size(); i++)
+  {
+    Entry& entry = entries[i];
+    entry.firstChunk = tasks.size();
+    uint64_t offset = 0;
+    do
+    {
+      uint64_t length = entry.size - offset < ChunkSize ? entry.size - offset : ChunkSize;
+      Task task = { entry.archive, &entry, offset, length, 0 };
+      tasks.push_back(task);
+      offset += length;
+    } while (offset < entry.size);
+    entry.numChunks = tasks.size() - entry.firstChunk;
+  }
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < numThreads; t++)
+    threads.push_back(std::thread(worker, std::ref(tasks), std::ref(next)));
+  worker(tasks, next);
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  // glue chunks of each entry together and compare
+  for (size_t i = 0; i < entries.size(); i++)
+  {
+    Entry& entry = entries[i];
+    uint32_t crc = tasks[entry.firstChunk].crc;
+    for (size_t c = 1; c < entry.numChunks; c++)
+      crc = crc32_combine(crc, tasks[entry.firstChunk + c].crc, tasks[entry.firstChunk + c].length);
+    if (crc == entry.expected)
+      entry.archive->verified++;
+    else
+    {
+      printf("%s: %s: FAILED (recorded %08x, computed %08x)\n",
+             entry.archive->name.c_str(), entry.name.c_str(), entry.expected, crc);
+      entry.archive->failed++;
+    }
+  }
+
+  int exitCode = 0;
+  for (size_t i = 0; i < archives.size(); i++)
+  {
+    Archive& archive = archives[i];
+    if (!archive.error.empty())
+    {
+      printf("%s: ERROR: %s\n", archive.name.c_str(), archive.error.c_str());
+      exitCode = 1;
+    }
+    printf("%s: %zu OK, %zu FAILED, %zu skipped (compressed), %zu skipped (encrypted)\n",
+           archive.name.c_str(), archive.verified, archive.failed, archive.skipped, archive.encrypted);
+    if (archive.failed)
+      exitCode = 1;
+    if (archive.data)
+      munmap((void*) archive.data, archive.size);
+  }
+  return exitCode;
+}